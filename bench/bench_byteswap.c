@@ -0,0 +1,115 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Measures how fast big endian int and long arrays are converted to native endianness,
+ * comparing the bulk conversion the NBT parser uses against swapping one element at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "nbt/byteswap.h"
+
+// A 1.16 chunk section has 256 longs of block states, this is roughly a region's worth of them.
+#define ELEMENTS (1024 * 16 * 256)
+#define ROUNDS 50
+
+static void swap_each(void *dst, const void *src, size_t n, size_t size)
+{
+  memcpy(dst, src, n * size);
+  for(size_t i = 0; i < n; i++)
+  {
+    unsigned char *b = (unsigned char *) dst + i * size;
+    for(size_t lo = 0, hi = size - 1; lo < hi; lo++, hi--)
+    {
+      unsigned char t = b[lo];
+      b[lo] = b[hi];
+      b[hi] = t;
+    }
+  }
+}
+
+static void swap_each32(void *dst, const void *src, size_t n) { swap_each(dst, src, n, 4); }
+static void swap_each64(void *dst, const void *src, size_t n) { swap_each(dst, src, n, 8); }
+static void bulk32(void *dst, const void *src, size_t n) { be32_to_ne_array(dst, src, n); }
+static void bulk64(void *dst, const void *src, size_t n) { be64_to_ne_array(dst, src, n); }
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, void (*convert)(void *, const void *, size_t),
+    void *dst, const void *src, size_t n, size_t size)
+{
+  convert(dst, src, n); // warm up
+
+  double start = now();
+  for(int i = 0; i < ROUNDS; i++) convert(dst, src, n);
+  double elapsed = now() - start;
+
+  printf("%-12s %8.2f GB/s\n", name, (double) n * size * ROUNDS / elapsed / 1e9);
+}
+
+int main(void)
+{
+  // One extra byte so that the source can be misaligned, like arrays inside a decompressed chunk are.
+  unsigned char *src = malloc(ELEMENTS * 8 + 1);
+  int64_t *dst = malloc(ELEMENTS * 8);
+  int64_t *check = malloc(ELEMENTS * 8);
+  if(src == NULL || dst == NULL || check == NULL)
+  {
+    fprintf(stderr, "Could not allocate memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  srand(1);
+  for(size_t i = 0; i < ELEMENTS * 8 + 1; i++) src[i] = (unsigned char) rand();
+  const unsigned char *unaligned = src + 1;
+
+  swap_each64(check, unaligned, ELEMENTS);
+  bulk64(dst, unaligned, ELEMENTS);
+  if(memcmp(check, dst, ELEMENTS * 8) != 0)
+  {
+    fprintf(stderr, "Bulk long conversion gave a different result.\n");
+    exit(EXIT_FAILURE);
+  }
+  swap_each32(check, unaligned, ELEMENTS * 2);
+  bulk32(dst, unaligned, ELEMENTS * 2);
+  if(memcmp(check, dst, ELEMENTS * 8) != 0)
+  {
+    fprintf(stderr, "Bulk int conversion gave a different result.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  run("int each", swap_each32, dst, unaligned, ELEMENTS * 2, 4);
+  run("int bulk", bulk32, dst, unaligned, ELEMENTS * 2, 4);
+  run("long each", swap_each64, dst, unaligned, ELEMENTS, 8);
+  run("long bulk", bulk64, dst, unaligned, ELEMENTS, 8);
+
+  free(src);
+  free(dst);
+  free(check);
+  return EXIT_SUCCESS;
+}
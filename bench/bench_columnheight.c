@@ -0,0 +1,144 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Measures how fast the column heights of legacy chunk sections are worked out,
+ * comparing the kernel the DEM uses, which goes over the sections of a chunk from the top down and stops
+ * once every column has hit ground, against looking up every block of every section one at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "columnheight.h"
+
+// Roughly the sections of a region with 8 sections in every chunk.
+#define SECTIONS (1024 * 8)
+#define ROUNDS 20
+
+static const uint8_t ignored_blocks[] = {0, 18, 161, 17, 162, 8, 9};
+
+static struct ground_blocks ground;
+static struct ground_bitset bitset;
+
+static bool raise_each(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y)
+{
+  (void) found;
+  for(int y = 15; y >= 0; y--)
+  {
+    uint8_t current_y = (uint8_t) (base_y + y);
+    for(size_t j = 0; j < 256; j++)
+    {
+      if(ground.is_ground[blocks[y * 256 + j]] && heightmap[j] < current_y) heightmap[j] = current_y;
+    }
+  }
+  return false;
+}
+
+static bool raise_kernel(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y)
+{
+  return raise_columns(heightmap, found, blocks, base_y, &ground, &bitset);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef bool (*raise_func_t)(uint8_t *heightmap, uint8_t *found, const uint8_t *blocks, uint8_t base_y);
+
+// Every 8 sections make up a chunk, the top one last.
+static void heights(raise_func_t raise, uint8_t *heightmaps, const uint8_t *blocks)
+{
+  memset(heightmaps, 0, SECTIONS / 8 * 256);
+  for(size_t chunk = 0; chunk < SECTIONS / 8; chunk++)
+  {
+    uint8_t found[256] = {0};
+    for(int s = 7; s >= 0; s--)
+    {
+      size_t section = chunk * 8 + s;
+      if(raise(heightmaps + chunk * 256, found, blocks + section * 4096, (uint8_t) (s * 16))) break;
+    }
+  }
+}
+
+static void run(const char *name, raise_func_t raise,
+    uint8_t *heightmaps, const uint8_t *blocks)
+{
+  heights(raise, heightmaps, blocks); // warm up
+
+  double start = now();
+  for(int i = 0; i < ROUNDS; i++) heights(raise, heightmaps, blocks);
+  double elapsed = now() - start;
+
+  printf("%-8s %8.1f ns/section\n", name, elapsed / ROUNDS / SECTIONS * 1e9);
+}
+
+int main(void)
+{
+  uint8_t *blocks = malloc((size_t) SECTIONS * 4096);
+  uint8_t *heightmaps = malloc(SECTIONS / 8 * 256);
+  uint8_t *check = malloc(SECTIONS / 8 * 256);
+  if(blocks == NULL || heightmaps == NULL || check == NULL)
+  {
+    fprintf(stderr, "Could not allocate memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(ground.is_ground, 1, sizeof(ground.is_ground));
+  for(size_t i = 0; i < sizeof(ignored_blocks); i++) ground.is_ground[ignored_blocks[i]] = false;
+  ground_bitset_init(&bitset, &ground);
+
+  // Air above a random surface in the top two sections, with some ignored blocks below it.
+  // Minecraft leaves out sections that are all air, so every section has some blocks.
+  srand(1);
+  for(size_t chunk = 0; chunk < SECTIONS / 8; chunk++)
+  {
+    for(size_t j = 0; j < 256; j++)
+    {
+      int surface = 100 + rand() % 20;
+      for(int y = 0; y < 128; y++)
+      {
+        uint8_t id = y > surface ? 0 : rand() % 4 == 0 ? ignored_blocks[rand() % sizeof(ignored_blocks)] : 1;
+        blocks[(chunk * 8 + y / 16) * 4096 + y % 16 * 256 + j] = id;
+      }
+    }
+  }
+
+  heights(raise_each, check, blocks);
+  heights(raise_kernel, heightmaps, blocks);
+  if(memcmp(check, heightmaps, SECTIONS / 8 * 256) != 0)
+  {
+    fprintf(stderr, "The kernel gave different heights.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  run("each", raise_each, heightmaps, blocks);
+  run("kernel", raise_kernel, heightmaps, blocks);
+
+  free(blocks);
+  free(heightmaps);
+  free(check);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+function(add_cmocka_test name)
+  # parse arguments passed to the function
+  set(options )
+  set(oneValueArgs )
+  set(multiValueArgs SOURCES COMPILE_OPTIONS LINK_LIBRARIES LINK_OPTIONS)
+  cmake_parse_arguments(ADD_CMOCKA_TEST "${options}" "${oneValueArgs}"
+    "${multiValueArgs}" ${ARGN} )
+
+  if (NOT ADD_CMOCKA_TEST_SOURCES)
+    message(FATAL_ERROR "No sources given for test ${name}")
+  endif()
+
+  # define test
+  add_executable(${name} ${ADD_CMOCKA_TEST_SOURCES})
+  if (ADD_CMOCKA_TEST_COMPILE_OPTIONS)
+    target_compile_options(${name} PRIVATE ${ADD_CMOCKA_TEST_COMPILE_OPTIONS})
+  endif()
+  target_include_directories(${name} PRIVATE ${CMOCKA_INCLUDE_DIR})
+  target_link_libraries(${name} ${ADD_CMOCKA_TEST_LINK_LIBRARIES})
+  if (ADD_CMOCKA_TEST_LINK_OPTIONS)
+    set_target_properties(${name} PROPERTIES LINK_FLAGS "${ADD_CMOCKA_TEST_LINK_OPTIONS}")
+  endif()
+
+  add_test(NAME ${name} COMMAND ${name})
+endfunction(add_cmocka_test)
@@ -0,0 +1,219 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "arena.h"
+#include "nbt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT  alignof(max_align_t)
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+#define INTERN_INITIAL_CAPACITY 64
+
+struct arena_block {
+    struct arena_block* next; /* The previously filled block, if any. */
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static struct arena_block* block_new(size_t size, struct arena_block* next)
+{
+    struct arena_block* block = malloc(sizeof *block + size);
+    if(block == NULL) return NULL;
+
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+struct nbt_arena* nbt_arena_new(void)
+{
+    struct nbt_arena* arena = malloc(sizeof *arena);
+    if(arena == NULL)
+    {
+        errno = NBT_EMEM;
+        return NULL;
+    }
+
+    arena->head = NULL;
+    arena->names.slots    = NULL;
+    arena->names.capacity = 0;
+    arena->names.count    = 0;
+    return arena;
+}
+
+void* nbt_arena_alloc(struct nbt_arena* arena, size_t n)
+{
+    assert(arena);
+
+    n = n == 0 ? ARENA_ALIGNMENT : align_up(n);
+    if(n == 0) return NULL; /* overflow */
+
+    struct arena_block* head = arena->head;
+
+    if(head == NULL || head->size - head->used < n)
+    {
+        size_t size = head ? head->size * 2 : ARENA_BLOCK_SIZE;
+        if(size < n) size = n;
+
+        if((head = block_new(size, head)) == NULL)
+            return NULL;
+
+        arena->head = head;
+    }
+
+    void* ret = head->data + head->used;
+    head->used += n;
+
+    return ret;
+}
+
+/* FNV-1a */
+static size_t hash_name(const char* name, size_t length)
+{
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+/* Returns the slot holding `name', or the empty slot it belongs in. */
+static struct intern_slot* find_slot(struct intern_slot* slots, size_t capacity, const char* name, size_t length)
+{
+    size_t i = hash_name(name, length) & (capacity - 1);
+
+    while(slots[i].name != NULL && (slots[i].length != length || memcmp(slots[i].name, name, length) != 0))
+        i = (i + 1) & (capacity - 1);
+
+    return &slots[i];
+}
+
+/* Doubles the room in the table. Returns non-zero if out of memory. */
+static int grow_names(struct intern_table* names)
+{
+    size_t capacity = names->capacity ? names->capacity * 2 : INTERN_INITIAL_CAPACITY;
+
+    struct intern_slot* slots = calloc(capacity, sizeof *slots);
+    if(slots == NULL) return 1;
+
+    for(size_t i = 0; i < names->capacity; i++)
+        if(names->slots[i].name != NULL)
+            *find_slot(slots, capacity, names->slots[i].name, names->slots[i].length) = names->slots[i];
+
+    free(names->slots);
+    names->slots    = slots;
+    names->capacity = capacity;
+    return 0;
+}
+
+char* nbt_arena_intern_n(struct nbt_arena* arena, const char* name, size_t length)
+{
+    assert(arena);
+    assert(name);
+
+    struct intern_table* names = &arena->names;
+
+    /* the copy is handed out as a C string, which would end early */
+    if(memchr(name, '\0', length) != NULL) return NULL;
+
+    if(names->capacity != 0)
+    {
+        struct intern_slot* slot = find_slot(names->slots, names->capacity, name, length);
+        if(slot->name != NULL) return slot->name;
+    }
+
+    if(names->count >= NBT_ARENA_MAX_NAMES) return NULL;
+
+    /* stay at most half full, so probes are short */
+    if((names->count + 1) * 2 > names->capacity && grow_names(names))
+        return NULL;
+
+    char* copy = malloc(length + 1);
+    if(copy == NULL) return NULL;
+
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+
+    struct intern_slot* slot = find_slot(names->slots, names->capacity, name, length);
+    slot->name   = copy;
+    slot->length = length;
+    names->count++;
+
+    return copy;
+}
+
+const char* nbt_arena_intern(struct nbt_arena* arena, const char* name)
+{
+    assert(name);
+
+    const char* ret = nbt_arena_intern_n(arena, name, strlen(name));
+    if(ret == NULL) errno = NBT_EMEM;
+
+    return ret;
+}
+
+void nbt_arena_reset(struct nbt_arena* arena)
+{
+    assert(arena);
+
+    struct arena_block* head = arena->head;
+    if(head == NULL) return;
+
+    if(head->next == NULL)
+    {
+        head->used = 0;
+        return;
+    }
+
+    size_t total = 0;
+    while(head != NULL)
+    {
+        struct arena_block* next = head->next;
+        total += head->size;
+        free(head);
+        head = next;
+    }
+
+    /* If this fails the next allocation just starts over small. */
+    arena->head = block_new(total, NULL);
+}
+
+void nbt_arena_free(struct nbt_arena* arena)
+{
+    if(arena == NULL) return;
+
+    struct arena_block* head = arena->head;
+    while(head != NULL)
+    {
+        struct arena_block* next = head->next;
+        free(head);
+        head = next;
+    }
+
+    for(size_t i = 0; i < arena->names.capacity; i++)
+        free(arena->names.slots[i].name);
+    free(arena->names.slots);
+
+    free(arena);
+}
@@ -0,0 +1,60 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef NBT_ARENA_H
+#define NBT_ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+/*
+ * A tag name seen by an arena. The copy is NULL-terminated, but names are
+ * compared by `length', so that one can't be mistaken for a longer name.
+ */
+struct intern_slot {
+    char* name; /* NULL in empty slots. */
+    size_t length;
+};
+
+/*
+ * The tag names seen by an arena, each stored once. An open addressing hash
+ * table of interned names.
+ */
+struct intern_table {
+    struct intern_slot* slots;
+    size_t capacity; /* A power of two, or 0 before the first name. */
+    size_t count;
+};
+
+/*
+ * An arena hands out memory by bumping a pointer, and takes it all back at
+ * once with nbt_arena_reset. Blocks are chained when one runs out. On reset
+ * they are replaced by a single block large enough for all of them, so a
+ * reused arena settles into one slab.
+ */
+struct nbt_arena {
+    struct arena_block* head; /* The block currently allocated from. */
+    struct intern_table names; /* Not touched by resets. */
+};
+
+/*
+ * Returns `n' bytes aligned for any type, or NULL if out of memory. Never
+ * returns NULL for `n' == 0.
+ */
+void* nbt_arena_alloc(struct nbt_arena* arena, size_t n);
+
+/*
+ * Returns the arena's copy of the `length' bytes at `name', which need not be
+ * NULL-terminated. Returns NULL if out of memory, or if the arena already
+ * holds NBT_ARENA_MAX_NAMES names and this one is new.
+ */
+char* nbt_arena_intern_n(struct nbt_arena* arena, const char* name, size_t length);
+
+#endif
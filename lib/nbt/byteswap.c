@@ -0,0 +1,164 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "byteswap.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SHUFFLE
+#include <immintrin.h>
+#endif
+
+static bool little_endian(void)
+{
+    uint16_t t = 0x0001;
+    unsigned char c;
+    memcpy(&c, &t, 1);
+    return c;
+}
+
+static uint32_t bswap32(uint32_t v)
+{
+#ifdef __GNUC__
+    return __builtin_bswap32(v);
+#else
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+#endif
+}
+
+static uint64_t bswap64(uint64_t v)
+{
+#ifdef __GNUC__
+    return __builtin_bswap64(v);
+#else
+    return (uint64_t)bswap32((uint32_t)v) << 32 | bswap32((uint32_t)(v >> 32));
+#endif
+}
+
+static void swap32_scalar(int32_t* dst, const unsigned char* src, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        uint32_t v;
+        memcpy(&v, src + i * 4, 4);
+        v = bswap32(v);
+        memcpy(dst + i, &v, 4);
+    }
+}
+
+static void swap64_scalar(int64_t* dst, const unsigned char* src, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        uint64_t v;
+        memcpy(&v, src + i * 8, 8);
+        v = bswap64(v);
+        memcpy(dst + i, &v, 8);
+    }
+}
+
+#ifdef HAVE_X86_SHUFFLE
+
+/* pshufb masks reversing the bytes of each 4 or 8 byte lane */
+#define SHUFFLE32 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define SHUFFLE64 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+__attribute__((target("ssse3")))
+static size_t shuffle_ssse3(void* dst, const unsigned char* src, size_t bytes, __m128i mask)
+{
+    size_t i = 0;
+    for(; i + 16 <= bytes; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)((unsigned char*)dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t shuffle_avx2(void* dst, const unsigned char* src, size_t bytes, __m256i mask)
+{
+    size_t i = 0;
+    for(; i + 32 <= bytes; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)((unsigned char*)dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t swap32_ssse3(int32_t* dst, const unsigned char* src, size_t n)
+{
+    return shuffle_ssse3(dst, src, n * 4, _mm_setr_epi8(SHUFFLE32)) / 4;
+}
+
+__attribute__((target("ssse3")))
+static size_t swap64_ssse3(int64_t* dst, const unsigned char* src, size_t n)
+{
+    return shuffle_ssse3(dst, src, n * 8, _mm_setr_epi8(SHUFFLE64)) / 8;
+}
+
+__attribute__((target("avx2")))
+static size_t swap32_avx2(int32_t* dst, const unsigned char* src, size_t n)
+{
+    return shuffle_avx2(dst, src, n * 4, _mm256_setr_epi8(SHUFFLE32, SHUFFLE32)) / 4;
+}
+
+__attribute__((target("avx2")))
+static size_t swap64_avx2(int64_t* dst, const unsigned char* src, size_t n)
+{
+    return shuffle_avx2(dst, src, n * 8, _mm256_setr_epi8(SHUFFLE64, SHUFFLE64)) / 8;
+}
+
+#endif
+
+void be32_to_ne_array(int32_t* dst, const void* src, size_t n)
+{
+    const unsigned char* s = src;
+
+    if(!little_endian())
+    {
+        memcpy(dst, src, n * 4);
+        return;
+    }
+
+    size_t done = 0;
+#ifdef HAVE_X86_SHUFFLE
+    if(__builtin_cpu_supports("avx2"))
+        done = swap32_avx2(dst, s, n);
+    else if(__builtin_cpu_supports("ssse3"))
+        done = swap32_ssse3(dst, s, n);
+#endif
+
+    swap32_scalar(dst + done, s + done * 4, n - done);
+}
+
+void be64_to_ne_array(int64_t* dst, const void* src, size_t n)
+{
+    const unsigned char* s = src;
+
+    if(!little_endian())
+    {
+        memcpy(dst, src, n * 8);
+        return;
+    }
+
+    size_t done = 0;
+#ifdef HAVE_X86_SHUFFLE
+    if(__builtin_cpu_supports("avx2"))
+        done = swap64_avx2(dst, s, n);
+    else if(__builtin_cpu_supports("ssse3"))
+        done = swap64_ssse3(dst, s, n);
+#endif
+
+    swap64_scalar(dst + done, s + done * 8, n - done);
+}
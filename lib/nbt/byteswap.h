@@ -0,0 +1,24 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef NBT_BYTESWAP_H
+#define NBT_BYTESWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Copies `n' big endian integers from `src' to `dst', converting them to
+ * native endianness on the way. `src' may be unaligned, and the buffers must
+ * not overlap. On x86 this uses AVX2 or SSSE3 when the CPU has them.
+ */
+void be32_to_ne_array(int32_t* dst, const void* src, size_t n);
+void be64_to_ne_array(int64_t* dst, const void* src, size_t n);
+
+#endif
@@ -21,7 +21,6 @@ extern "C" {
 #include <stdio.h>  /* for FILE* */
 
 #include "buffer.h" /* for struct buffer */
-#include "list.h"   /* For struct list_entry etc. */
 
 typedef enum {
     NBT_OK   =  0, /* No error. */
@@ -84,48 +83,44 @@ typedef struct nbt_node {
             int32_t length;
         } tag_byte_array;
 
+        /*
+         * Borrowed int and long arrays (see nbt_parse_borrowed) are still
+         * big endian and may be unaligned. Read them with
+         * nbt_int_array_get and nbt_long_array_get, which work for all.
+         */
         struct nbt_int_array {
             int32_t* data;
             int32_t length;
+            bool big_endian;
         } tag_int_array;
 
         struct nbt_long_array {
             int64_t* data;
             int32_t length;
+            bool big_endian;
         } tag_long_array;
 
         char* tag_string; /* TODO: technically, this should be a UTF-8 string */
 
         /*
-         * Design addendum: we make tag_list a linked list instead of an array
-         * so that nbt_node can be a true recursive data structure. If we used
-         * an array, it would be incorrect to call free() on any element except
-         * the first one. By using a linked list, the context of the node is
-         * irrelevant. One tradeoff of this design is that we don't get tight
-         * list packing when memory is a concern and huge lists are created.
+         * Lists and compounds keep pointers to their children in a single
+         * array, in the order they were read. Indexing is O(1) and walking
+         * the children doesn't chase pointers around the heap. Each child is
+         * still a node of its own, so any node of a tree can be passed to
+         * nbt_free once it has been taken out of its parent.
          *
-         * For more information on using the linked list, see `list.h'. The API
-         * is well documented.
+         * Lists remember the type of their elements in `type', so that empty
+         * lists still possess one. Compounds leave it at TAG_INVALID.
+         *
+         * Use nbt_list_for_each to iterate over the children.
          */
         struct nbt_list {
-            struct nbt_node* data; /* A single node's data. */
-            struct list_head entry;
+            struct nbt_node** items;
+            size_t length;
+            size_t capacity; /* Internal use. The allocated length of `items'. */
+            nbt_type type;
         } * tag_list,
           * tag_compound;
-
-        /*
-         * The primary difference between a tag_list and a tag_compound is the
-         * use of the first (sentinel) node.
-         *
-         * In an nbt_list, the sentinel node contains a valid data pointer with
-         * only the type filled in. This is to deal with empty lists which
-         * still posess types. Therefore, the sentinel's data pointer must be
-         * deallocated.
-         *
-         * In the tag_compound, the only use of the sentinel is to get the
-         * beginning and end of the doubly linked list. The data pointer is
-         * unused and set to NULL.
-         */
     } payload;
 } nbt_node;
 
@@ -153,6 +148,48 @@ nbt_node* nbt_parse_path(const char* filename);
  */
 nbt_node* nbt_parse_compressed(const void* chunk_start, size_t length);
 
+/*
+ * Keeps the resources needed for decompression alive between calls. When
+ * decompressing lots of chunks in a row, reusing a decompressor means that
+ * once its internal buffer has grown to fit the largest chunk, decompression
+ * doesn't allocate anymore. A decompressor must only be used by one thread at
+ * a time.
+ */
+struct nbt_decompressor;
+
+/*
+ * Creates a decompressor. If an error occurs, NULL will be returned and errno
+ * will be set. Free it with nbt_decompressor_free.
+ */
+struct nbt_decompressor* nbt_decompressor_new(void);
+
+void nbt_decompressor_free(struct nbt_decompressor*);
+
+/*
+ * Decompresses a zlib or gzip stream into the decompressor's internal buffer,
+ * and returns a pointer to the decompressed data. Its length is stored in
+ * `out_length'. The data stays valid until the next call with the same
+ * decompressor. If an error occurs, NULL will be returned and errno will be
+ * set to the appropriate nbt_status.
+ */
+const void* nbt_decompress(struct nbt_decompressor*, const void* mem,
+                           size_t length, size_t* out_length);
+
+/*
+ * The same as nbt_decompress, but for a LZ4 stream as written by lz4-java's
+ * LZ4BlockOutputStream, which is what Minecraft uses for chunks stored with
+ * compression scheme 4. Checksums are not verified.
+ */
+const void* nbt_decompress_lz4(struct nbt_decompressor*, const void* mem,
+                               size_t length, size_t* out_length);
+
+/*
+ * The same as nbt_parse_compressed, but decompresses with the resources of the
+ * given decompressor instead of setting up new ones.
+ */
+nbt_node* nbt_parse_compressed_with(struct nbt_decompressor*,
+                                    const void* chunk_start, size_t length);
+
 /*
  * Dumps a tree into a file. Check your damn error codes. This function should
  * return NBT_OK.
@@ -183,6 +220,65 @@ struct buffer nbt_dump_compressed(const nbt_node* tree,
  */
 nbt_node* nbt_parse(const void* memory, size_t length);
 
+/*
+ * An arena keeps the memory of parsed trees around for reuse. A tree parsed
+ * into an arena lives in a few large blocks instead of a malloc per tag, and
+ * is thrown away all at once by resetting the arena. An arena must only be
+ * used by one thread at a time.
+ */
+struct nbt_arena;
+
+/*
+ * Creates an empty arena. If an error occurs, NULL will be returned and errno
+ * will be set. Free it with nbt_arena_free.
+ */
+struct nbt_arena* nbt_arena_new(void);
+
+/*
+ * Invalidates every tree parsed into the arena, keeping its memory for the
+ * next ones.
+ */
+void nbt_arena_reset(struct nbt_arena*);
+
+void nbt_arena_free(struct nbt_arena*);
+
+/* The most tag names an arena keeps. Trees get private copies of the rest. */
+#define NBT_ARENA_MAX_NAMES 4096
+
+/*
+ * Trees parsed into an arena share a single copy of every tag name, which
+ * outlives resets. Returns that copy of `name', so tags can be looked up with
+ * nbt_compound_get_interned. Returns NULL and sets errno if out of memory or
+ * out of names.
+ */
+const char* nbt_arena_intern(struct nbt_arena*, const char* name);
+
+/*
+ * The same as nbt_parse, but allocates the tree from `arena'. The tree MUST
+ * NOT be passed to nbt_free, it stays valid until the arena is reset or
+ * freed. Everything else that reads a tree works on it as usual.
+ */
+nbt_node* nbt_parse_arena(struct nbt_arena* arena, const void* memory, size_t length);
+
+/*
+ * The same as nbt_parse_arena, but arrays are not copied. Their data points
+ * straight into `memory', which must stay alive and unchanged for as long as
+ * the tree is used. Byte arrays can be read as usual, int and long arrays
+ * only through nbt_int_array_get and nbt_long_array_get.
+ */
+nbt_node* nbt_parse_borrowed(struct nbt_arena* arena, const void* memory, size_t length);
+
+/*
+ * The same as nbt_parse_borrowed, but only parses the tags on the way to one
+ * of `paths', and everything under the tags they end at. All other tags are
+ * stepped over without allocating. `paths' is a NULL-terminated list of at
+ * most 64 paths written like those of nbt_find_by_path, but without the name
+ * of the root: "Level.Sections..Y" keeps the Y tags of the compounds in the
+ * Sections list of the Level compound. Returns NULL and sets errno to NBT_ERR
+ * if there are more than 64 paths.
+ */
+nbt_node* nbt_parse_paths(struct nbt_arena* arena, const void* memory, size_t length, const char* const* paths);
+
 /*
  * Returns a NULL-terminated string as the ascii representation of the tree. If
  * an error occurs, NULL will be returned and errno will be set.
@@ -203,6 +299,139 @@ char* nbt_dump_ascii(const nbt_node* tree);
  */
 struct buffer nbt_dump_binary(const nbt_node* tree);
 
+                     /***** Streaming Functions *****/
+
+/*
+ * What a scan callback wants to happen next. NBT_SCAN_SKIP only matters for
+ * lists and compounds: their contents are stepped over without being
+ * reported.
+ */
+typedef enum {
+    NBT_SCAN_CONTINUE,
+    NBT_SCAN_SKIP,
+    NBT_SCAN_STOP
+} nbt_scan_action;
+
+/*
+ * A tag as seen by a scan. Everything in here is borrowed from the memory
+ * being scanned and only valid during the callback. Names and strings are NOT
+ * null-terminated. Array data is stored as-is, so int and long arrays are
+ * big endian and possibly unaligned.
+ */
+struct nbt_scan_tag {
+    nbt_type type;
+    const char* name;   /* NULL for list elements. */
+    size_t name_length;
+    int32_t index;      /* Index within the parent list, -1 otherwise. */
+    int depth;          /* 0 for the root tag. */
+    size_t offset;      /* Of the payload, counting from the start of the scan. */
+
+    union {
+        int8_t  tag_byte;
+        int16_t tag_short;
+        int32_t tag_int;
+        int64_t tag_long;
+        float   tag_float;
+        double  tag_double;
+
+        struct {
+            const void* data;
+            int32_t length; /* In elements, not bytes. */
+        } tag_array; /* TAG_BYTE_ARRAY, TAG_INT_ARRAY and TAG_LONG_ARRAY */
+
+        struct {
+            const char* data;
+            size_t length;
+        } tag_string;
+
+        struct {
+            nbt_type type;
+            int32_t length;
+        } tag_list;
+    } payload;
+};
+
+/*
+ * `enter' is called for every tag, before the contents of a list or compound.
+ * `leave' is called once all contents of a list or compound have been
+ * scanned, unless it was skipped. Either may be NULL.
+ */
+struct nbt_scan_callbacks {
+    nbt_scan_action (*enter)(const struct nbt_scan_tag* tag, void* aux);
+    nbt_scan_action (*leave)(const struct nbt_scan_tag* tag, void* aux);
+};
+
+/*
+ * Walks an uncompressed NBT tree in memory without building it, reporting
+ * each tag to the callbacks. Nothing is allocated. Returns NBT_OK when the
+ * whole tree was scanned or a callback stopped the scan, and NBT_ERR if the
+ * data is malformed. errno is set to the returned status.
+ */
+nbt_status nbt_scan(const void* memory, size_t length,
+                    const struct nbt_scan_callbacks*, void* aux);
+
+/* Returns true if the scanned tag is named `name'. */
+bool nbt_scan_name_is(const struct nbt_scan_tag*, const char* name);
+
+/*
+ * A tape indexes an uncompressed NBT tree in memory with one entry per tag,
+ * in the order the tags are stored. The children of a list or compound
+ * follow it directly: the first is at the next index, and every entry knows
+ * the index just past its contents, which is its next sibling. Offsets count
+ * from `memory', and names and strings there are NOT null-terminated.
+ */
+struct nbt_tape_entry {
+    uint8_t type;        /* An nbt_type. */
+    uint8_t item_type;   /* The type of the items, for lists. */
+    uint16_t name_length;
+    uint32_t name;       /* Offset of the name, 0 for list items. */
+    uint32_t payload;    /* Offset of the payload, after any length prefix. */
+    int32_t length;      /* Elements of arrays and lists, bytes of strings, children of compounds. */
+    uint32_t next;       /* Index of the entry after this tag and its contents. */
+};
+
+struct nbt_tape {
+    const unsigned char* memory;
+    size_t length;
+
+    struct nbt_tape_entry* entries;
+    size_t count;
+    size_t capacity;
+};
+
+/* Returned by tape lookups that find nothing. */
+#define NBT_TAPE_NONE ((size_t)-1)
+
+/*
+ * Creates an empty tape. If an error occurs, NULL will be returned and errno
+ * will be set. Free it with nbt_tape_free.
+ */
+struct nbt_tape* nbt_tape_new(void);
+
+void nbt_tape_free(struct nbt_tape*);
+
+/*
+ * Checks the tree at `memory' and indexes it into `tape', replacing what the
+ * tape held before. Reusing a tape keeps its entries around, so indexing only
+ * allocates when a tree has more tags than any before it. `memory' must stay
+ * alive and unchanged for as long as the tape is used. Returns an nbt_status,
+ * which errno is set to as well.
+ */
+nbt_status nbt_tape_index(struct nbt_tape* tape, const void* memory, size_t length);
+
+/*
+ * Returns the index of the child of the compound at `index' named `name', or
+ * NBT_TAPE_NONE if it has none or is not a compound.
+ */
+size_t nbt_tape_child(const struct nbt_tape* tape, size_t index, const char* name);
+
+/*
+ * Builds the tree of the tag at `index' into `arena', as nbt_parse_borrowed
+ * would. Only that tag and its contents are turned into nodes. If an error
+ * occurs, NULL will be returned and errno will be set.
+ */
+nbt_node* nbt_tape_node(struct nbt_arena* arena, const struct nbt_tape* tape, size_t index);
+
                    /***** Tree Manipulation Functions *****/
 
 /*
@@ -237,14 +466,36 @@ typedef bool (*nbt_predicate_t)(const nbt_node* node, void* aux);
 
 /*
  * Traverses the tree until a visitor says stop or all elements are exhausted.
- * Returns false if it was terminated by a visitor, true otherwise. In most
- * cases this can be ignored.
+ * Returns false if it was terminated by a visitor, or if out of memory, in
+ * which case errno is set to NBT_EMEM. Otherwise returns true. In most cases
+ * this can be ignored.
  *
  * TODO: Is there a way to do this without expensive function pointers? Maybe
- * something like list_for_each?
+ * something like nbt_list_for_each?
  */
 bool nbt_map(nbt_node* tree, nbt_visitor_t, void* aux);
 
+/*
+ * What a walker wants to happen next. NBT_VISIT_SKIP only matters for lists
+ * and compounds: their contents are not visited.
+ */
+typedef enum {
+    NBT_VISIT_CONTINUE,
+    NBT_VISIT_SKIP,
+    NBT_VISIT_STOP
+} nbt_visit_action;
+
+typedef nbt_visit_action (*nbt_walker_t)(nbt_node* node, void* aux);
+
+/*
+ * Visits `tree' and everything in it, parents before their contents, in the
+ * order they are stored. Unlike nbt_map, the walker can leave out the
+ * contents of a list or compound. Keeps its own stack instead of recursing,
+ * so deep trees are fine. Returns NBT_OK, also when the walker stopped, or
+ * NBT_EMEM.
+ */
+nbt_status nbt_walk(nbt_node* tree, nbt_walker_t, void* aux);
+
 /*
  * Returns a new tree, consisting of a copy of all the nodes the predicate
  * returned `true' for. If the new tree is empty, this function will return
@@ -284,6 +535,19 @@ nbt_node* nbt_find(nbt_node* tree, nbt_predicate_t, void* aux);
  */
 nbt_node* nbt_find_by_name(nbt_node* tree, const char* name);
 
+/*
+ * Returns the child of `compound' named `name', or NULL if it has none or is
+ * not a compound. Unlike nbt_find_by_name, only the compound's own children
+ * are looked at, not the whole subtree.
+ */
+nbt_node* nbt_compound_get(nbt_node* compound, const char* name);
+
+/*
+ * The same as nbt_compound_get, but compares names by pointer. `compound'
+ * must have been parsed into an arena, and `name' interned by that arena.
+ */
+nbt_node* nbt_compound_get_interned(nbt_node* compound, const char* name);
+
 /*
  * Returns the first node with the "path" in the tree of `path'. If no such node
  * exists, returns NULL. If an element has no name, something like:
@@ -299,15 +563,70 @@ nbt_node* nbt_find_by_path(nbt_node* tree, const char* path);
 size_t nbt_size(const nbt_node* tree);
 
 /*
- * Returns the Nth item of a list
- * Don't use this to iterate through a list, it would be very inefficient
+ * Returns the Nth item of a list or compound, or NULL if it has less items.
  */
 nbt_node* nbt_list_item(nbt_node* list, int n);
 
+/*
+ * A selector finds a number of paths in a tree with a single walk over it.
+ * Compile one once, then use it on every tree that needs the same tags. A
+ * selector must only be used by one thread at a time.
+ */
+struct nbt_selector;
+
+/*
+ * What a selector found for one of its paths. `nodes' holds `count' nodes,
+ * NULL where a tag is missing. That is one node for most paths, and one for
+ * every item of the list for paths going through list items. If that list
+ * isn't there, `count' is 0.
+ */
+struct nbt_selection {
+    nbt_node** nodes;
+    size_t count;
+};
+
+/*
+ * Compiles a NULL-terminated list of paths, written as for nbt_parse_paths.
+ * A path may go through the items of at most one list. If `arena' is not
+ * NULL, names are compared by pointer and the selector only works on trees
+ * parsed into that arena. Returns NULL and sets errno if a path is invalid
+ * or out of memory.
+ */
+struct nbt_selector* nbt_selector_new(struct nbt_arena* arena, const char* const* paths);
+
+void nbt_selector_free(struct nbt_selector*);
+
+/*
+ * Finds all paths of `selector' in `tree'. Returns a selection per path, in
+ * the order the paths were given, which stays valid until the selector is
+ * used again. If a compound has several tags of the same name, the first one
+ * is taken. Returns NULL and sets errno if out of memory.
+ */
+const struct nbt_selection* nbt_select(struct nbt_selector* selector, nbt_node* tree);
+
+/*
+ * Iterates over the children of a list or compound payload (a struct
+ * nbt_list*). `pos' must be a struct nbt_node**, and points at the current
+ * child.
+ *
+ * Usage:
+ *   nbt_node** pos;
+ *   nbt_list_for_each(pos, tree->payload.tag_compound)
+ *       do_something(*pos);
+ */
+#define nbt_list_for_each(pos, list) \
+    for((pos) = (list)->items; (pos) != (list)->items + (list)->length; ++(pos))
+
 /* TODO: More utilities as requests are made and patches contributed. */
 
                       /***** Utility Functions *****/
 
+/* Returns element `i' of an int array in native byte order. */
+int32_t nbt_int_array_get(const struct nbt_int_array*, int32_t i);
+
+/* Returns element `i' of a long array in native byte order. */
+int64_t nbt_long_array_get(const struct nbt_long_array*, int32_t i);
+
 /* Returns true if the trees are identical. */
 bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b);
 
@@ -0,0 +1,304 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include "arena.h"
+#include "scanning.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAPE_INITIAL_CAPACITY 1024
+
+struct tape_builder {
+    struct nbt_tape* tape;
+    int err;
+
+    /* The entries of the lists and compounds being indexed, by depth. */
+    size_t open[NBT_SCAN_MAX_DEPTH + 1];
+};
+
+struct nbt_tape* nbt_tape_new(void)
+{
+    struct nbt_tape* tape = calloc(1, sizeof *tape);
+    if(tape == NULL) errno = NBT_EMEM;
+
+    return tape;
+}
+
+void nbt_tape_free(struct nbt_tape* tape)
+{
+    if(tape == NULL) return;
+
+    free(tape->entries);
+    free(tape);
+}
+
+static int grow_tape(struct nbt_tape* tape)
+{
+    size_t capacity = tape->capacity ? tape->capacity * 2 : TAPE_INITIAL_CAPACITY;
+
+    struct nbt_tape_entry* entries = realloc(tape->entries, capacity * sizeof *entries);
+    if(entries == NULL) return NBT_EMEM;
+
+    tape->entries  = entries;
+    tape->capacity = capacity;
+    return NBT_OK;
+}
+
+static nbt_scan_action tape_enter(const struct nbt_scan_tag* tag, void* aux)
+{
+    struct tape_builder* b = aux;
+    struct nbt_tape* tape = b->tape;
+
+    if(tape->count == tape->capacity && (b->err = grow_tape(tape)) != NBT_OK)
+        return NBT_SCAN_STOP;
+
+    size_t index = tape->count++;
+    struct nbt_tape_entry* entry = &tape->entries[index];
+
+    entry->type        = (uint8_t)tag->type;
+    entry->item_type   = TAG_INVALID;
+    entry->name_length = (uint16_t)tag->name_length;
+    entry->name        = tag->name ? (uint32_t)((const unsigned char*)tag->name - tape->memory) : 0;
+    entry->payload     = (uint32_t)tag->offset;
+    entry->length      = 0;
+    entry->next        = (uint32_t)(index + 1);
+
+    switch(tag->type)
+    {
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+        entry->payload += 4;
+        entry->length   = tag->payload.tag_array.length;
+        break;
+    case TAG_STRING:
+        entry->payload += 2;
+        entry->length   = (int32_t)tag->payload.tag_string.length;
+        break;
+    case TAG_LIST:
+        entry->payload  += 5;
+        entry->item_type = (uint8_t)tag->payload.tag_list.type;
+        entry->length    = tag->payload.tag_list.length;
+        break;
+    default:
+        break;
+    }
+
+    if(tag->depth > 0)
+    {
+        struct nbt_tape_entry* parent = &tape->entries[b->open[tag->depth - 1]];
+        if(parent->type == TAG_COMPOUND) parent->length++;
+    }
+
+    if(tag->type == TAG_LIST || tag->type == TAG_COMPOUND)
+        b->open[tag->depth] = index;
+
+    return NBT_SCAN_CONTINUE;
+}
+
+static nbt_scan_action tape_leave(const struct nbt_scan_tag* tag, void* aux)
+{
+    struct tape_builder* b = aux;
+
+    b->tape->entries[b->open[tag->depth]].next = (uint32_t)b->tape->count;
+    return NBT_SCAN_CONTINUE;
+}
+
+nbt_status nbt_tape_index(struct nbt_tape* tape, const void* memory, size_t length)
+{
+    assert(tape);
+    assert(memory);
+
+    tape->memory = memory;
+    tape->length = length;
+    tape->count  = 0;
+
+    /* offsets and indices are stored in 32 bits */
+    if(length > UINT32_MAX) return (nbt_status)(errno = NBT_ERR);
+
+    static const struct nbt_scan_callbacks callbacks = { tape_enter, tape_leave };
+
+    struct tape_builder b;
+    b.tape = tape;
+    b.err  = NBT_OK;
+
+    nbt_status err = nbt_scan(memory, length, &callbacks, &b);
+    if(b.err != NBT_OK) err = (nbt_status)b.err;
+
+    if(err != NBT_OK) tape->count = 0;
+    return (nbt_status)(errno = err);
+}
+
+size_t nbt_tape_child(const struct nbt_tape* tape, size_t index, const char* name)
+{
+    assert(tape);
+    assert(name);
+
+    if(index >= tape->count || tape->entries[index].type != TAG_COMPOUND)
+        return NBT_TAPE_NONE;
+
+    size_t length = strlen(name);
+
+    for(size_t i = index + 1; i < tape->entries[index].next; i = tape->entries[i].next)
+    {
+        const struct nbt_tape_entry* child = &tape->entries[i];
+
+        if(child->name_length == length && memcmp(tape->memory + child->name, name, length) == 0)
+            return i;
+    }
+
+    return NBT_TAPE_NONE;
+}
+
+static uint16_t load_be16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t load_be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t load_be64(const unsigned char* p)
+{
+    return (uint64_t)load_be32(p) << 32 | load_be32(p + 4);
+}
+
+/* Copies `length' bytes into the arena, null-terminated. */
+static char* arena_strndup(struct nbt_arena* arena, const unsigned char* s, size_t length)
+{
+    char* ret = nbt_arena_alloc(arena, length + 1);
+    if(ret == NULL) return NULL;
+
+    memcpy(ret, s, length);
+    ret[length] = '\0';
+    return ret;
+}
+
+static nbt_node* build_node(struct nbt_arena* arena, const struct nbt_tape* tape, size_t index)
+{
+    const struct nbt_tape_entry* entry = &tape->entries[index];
+    const unsigned char* payload = tape->memory + entry->payload;
+
+    nbt_node* node = nbt_arena_alloc(arena, sizeof *node);
+    if(node == NULL) return NULL;
+
+    node->type = (nbt_type)entry->type;
+    node->name = NULL;
+
+    /* list items have no name, every other tag does, even if it's empty */
+    if(entry->name != 0)
+    {
+        const char* name = (const char*)tape->memory + entry->name;
+
+        if((node->name = nbt_arena_intern_n(arena, name, entry->name_length)) == NULL &&
+           (node->name = arena_strndup(arena, (const unsigned char*)name, entry->name_length)) == NULL)
+            return NULL;
+    }
+
+    switch(node->type)
+    {
+    case TAG_BYTE:
+        node->payload.tag_byte = (int8_t)payload[0];
+        break;
+    case TAG_SHORT:
+        node->payload.tag_short = (int16_t)load_be16(payload);
+        break;
+    case TAG_INT:
+        node->payload.tag_int = (int32_t)load_be32(payload);
+        break;
+    case TAG_LONG:
+        node->payload.tag_long = (int64_t)load_be64(payload);
+        break;
+    case TAG_FLOAT:
+    {
+        uint32_t bits = load_be32(payload);
+        memcpy(&node->payload.tag_float, &bits, sizeof bits);
+        break;
+    }
+    case TAG_DOUBLE:
+    {
+        uint64_t bits = load_be64(payload);
+        memcpy(&node->payload.tag_double, &bits, sizeof bits);
+        break;
+    }
+
+    /* arrays are borrowed from the indexed memory, like nbt_parse_borrowed does */
+    case TAG_BYTE_ARRAY:
+        node->payload.tag_byte_array.data   = (unsigned char*)payload;
+        node->payload.tag_byte_array.length = entry->length;
+        break;
+    case TAG_INT_ARRAY:
+        node->payload.tag_int_array.data       = (int32_t*)(void*)payload;
+        node->payload.tag_int_array.length     = entry->length;
+        node->payload.tag_int_array.big_endian = true;
+        break;
+    case TAG_LONG_ARRAY:
+        node->payload.tag_long_array.data       = (int64_t*)(void*)payload;
+        node->payload.tag_long_array.length     = entry->length;
+        node->payload.tag_long_array.big_endian = true;
+        break;
+
+    case TAG_STRING:
+        if((node->payload.tag_string = arena_strndup(arena, payload, (size_t)entry->length)) == NULL)
+            return NULL;
+        break;
+
+    case TAG_LIST:
+    case TAG_COMPOUND:
+    {
+        size_t capacity = entry->length > 0 ? (size_t)entry->length : 1;
+
+        struct nbt_list* list = nbt_arena_alloc(arena, sizeof *list);
+        if(list == NULL) return NULL;
+
+        if((list->items = nbt_arena_alloc(arena, capacity * sizeof *list->items)) == NULL)
+            return NULL;
+
+        list->length   = 0;
+        list->capacity = capacity;
+        list->type     = node->type == TAG_COMPOUND ? TAG_INVALID
+                       : entry->item_type == TAG_INVALID ? TAG_COMPOUND
+                       : (nbt_type)entry->item_type;
+
+        for(size_t i = index + 1; i < entry->next; i = tape->entries[i].next)
+            if((list->items[list->length++] = build_node(arena, tape, i)) == NULL)
+                return NULL;
+
+        if(node->type == TAG_LIST) node->payload.tag_list = list;
+        else                       node->payload.tag_compound = list;
+        break;
+    }
+
+    default:
+        assert(false); /* nbt_tape_index doesn't let those through */
+        return NULL;
+    }
+
+    return node;
+}
+
+nbt_node* nbt_tape_node(struct nbt_arena* arena, const struct nbt_tape* tape, size_t index)
+{
+    assert(arena);
+    assert(tape);
+    assert(index < tape->count);
+
+    nbt_node* ret = build_node(arena, tape, index);
+    if(ret == NULL) errno = NBT_EMEM;
+
+    return ret;
+}
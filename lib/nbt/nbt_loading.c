@@ -10,14 +10,18 @@
 #include "nbt.h"
 
 #include "buffer.h"
-#include "list.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
+#ifdef NBT_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 /*
  * zlib resources:
  *
@@ -145,76 +149,351 @@ compression_error:
 }
 
 /*
- * Reads in zlib-compressed data, and returns a buffer with the decompressed
- * data within. Returns a NULL buffer on failure, and sets errno appropriately.
+ * Chunks usually compress somewhere between 3 and 10 times. Sizing the output
+ * buffer at this many times the input size means that most streams fit on the
+ * first try.
  */
-static struct buffer __decompress(const void* mem, size_t len)
+#define RATIO_GUESS 8
+
+/* deflate can't expand its input more than this many times. */
+#define DEFLATE_MAX_RATIO 1032
+
+/*
+ * Everything needed to decompress a stream. The output buffer only ever grows,
+ * so once it has reached the size of the largest stream seen, decompressing
+ * doesn't allocate anymore.
+ */
+struct nbt_decompressor {
+    struct buffer out;
+
+#ifdef NBT_USE_LIBDEFLATE
+    struct libdeflate_decompressor* d;
+#else
+    z_stream stream;
+    bool stream_ready; /* has inflateInit2 been called on `stream' yet? */
+#endif
+};
+
+static nbt_status decompressor_init(struct nbt_decompressor* dec)
 {
-    struct buffer ret = BUFFER_INIT;
+    dec->out = BUFFER_INIT;
 
-    errno = NBT_OK;
+#ifdef NBT_USE_LIBDEFLATE
+    if((dec->d = libdeflate_alloc_decompressor()) == NULL)
+        return NBT_EMEM;
+#else
+    dec->stream_ready = false;
+#endif
 
-    z_stream stream = {
-        .zalloc   = Z_NULL,
-        .zfree    = Z_NULL,
-        .opaque   = Z_NULL,
-        .next_in  = (void*)mem,
-        .avail_in = len
-    };
+    return NBT_OK;
+}
+
+static void decompressor_destroy(struct nbt_decompressor* dec)
+{
+    buffer_free(&dec->out);
+
+#ifdef NBT_USE_LIBDEFLATE
+    libdeflate_free_decompressor(dec->d);
+#else
+    if(dec->stream_ready)
+        (void)inflateEnd(&dec->stream);
+#endif
+}
+
+#ifdef NBT_USE_LIBDEFLATE
+
+/*
+ * Decompresses zlib- or gzip-compressed data into dec->out with a single
+ * libdeflate call.
+ *
+ * libdeflate can't stream, so if the output doesn't fit, the buffer is doubled
+ * and decompression starts over. gzip streams store their decompressed size in
+ * the trailer, so those are sized correctly on the first try. The trailer can't
+ * be trusted though, so it is capped at what deflate can expand `len' bytes to.
+ */
+static nbt_status decompress_into(struct nbt_decompressor* dec, const void* mem, size_t len)
+{
+    const unsigned char* bytes = mem;
+    bool gzip = len >= 18 && bytes[0] == 0x1f && bytes[1] == 0x8b;
+
+    size_t guess;
+    if(gzip)
+        guess = (size_t)bytes[len - 4]       | (size_t)bytes[len - 3] << 8 |
+                (size_t)bytes[len - 2] << 16 | (size_t)bytes[len - 1] << 24;
+    else
+        guess = len * RATIO_GUESS;
+
+    if(guess > len * DEFLATE_MAX_RATIO)
+        guess = len * DEFLATE_MAX_RATIO;
+    if(guess < CHUNK_SIZE)
+        guess = CHUNK_SIZE;
+
+    enum libdeflate_result result;
 
-    /* "Add 32 to windowBits to enable zlib and gzip decoding with automatic
-     * header detection" */
-    if(inflateInit2(&stream, 15 + 32) != Z_OK)
+    for(;;)
     {
-        errno = NBT_EZ;
-        return BUFFER_INIT;
+        if(buffer_reserve(&dec->out, guess))
+            return NBT_EMEM;
+
+        result = gzip
+            ? libdeflate_gzip_decompress(dec->d, mem, len, dec->out.data, dec->out.cap, &dec->out.len)
+            : libdeflate_zlib_decompress(dec->d, mem, len, dec->out.data, dec->out.cap, &dec->out.len);
+
+        if(result != LIBDEFLATE_INSUFFICIENT_SPACE)
+            break;
+
+        guess = dec->out.cap * 2;
     }
 
-    int zlib_ret;
+    if(result != LIBDEFLATE_SUCCESS)
+    {
+        dec->out.len = 0;
+        return NBT_EZ;
+    }
 
-    do {
-        if(buffer_reserve(&ret, ret.len + CHUNK_SIZE))
-        {
-            errno = NBT_EMEM;
-            goto decompression_error;
-        }
+    return NBT_OK;
+}
 
-        stream.avail_out = CHUNK_SIZE;
-        stream.next_out  = (unsigned char*)ret.data + ret.len;
+#else
+
+/*
+ * Decompresses zlib- or gzip-compressed data into dec->out. The inflate state
+ * is only set up once and reset for every following stream.
+ */
+static nbt_status decompress_into(struct nbt_decompressor* dec, const void* mem, size_t len)
+{
+    z_stream* stream = &dec->stream;
+
+    if(!dec->stream_ready)
+    {
+        *stream = (z_stream) {
+            .zalloc = Z_NULL,
+            .zfree  = Z_NULL,
+            .opaque = Z_NULL
+        };
+
+        /* "Add 32 to windowBits to enable zlib and gzip decoding with automatic
+         * header detection" */
+        if(inflateInit2(stream, 15 + 32) != Z_OK)
+            return NBT_EZ;
+
+        dec->stream_ready = true;
+    }
+    else if(inflateReset(stream) != Z_OK)
+        return NBT_EZ;
+
+    stream->next_in  = (void*)mem;
+    stream->avail_in = len;
+
+    dec->out.len = 0;
+
+    size_t guess = len * RATIO_GUESS;
+    if(guess < CHUNK_SIZE)
+        guess = CHUNK_SIZE;
+
+    if(buffer_reserve(&dec->out, guess))
+        return NBT_EMEM;
+
+    for(;;)
+    {
+        size_t avail = dec->out.cap - dec->out.len;
+
+        stream->next_out  = dec->out.data + dec->out.len;
+        stream->avail_out = avail > UINT32_MAX ? UINT32_MAX : (uInt)avail;
+
+        uInt avail_before = stream->avail_out;
+        int zlib_ret = inflate(stream, Z_NO_FLUSH);
 
-        switch((zlib_ret = inflate(&stream, Z_NO_FLUSH)))
+        /* update our buffer length to reflect the new data */
+        dec->out.len += avail_before - stream->avail_out;
+
+        switch(zlib_ret)
         {
+        case Z_STREAM_END:
+            return NBT_OK;
+
         case Z_MEM_ERROR:
-            errno = NBT_EMEM;
-            /* fall through */
+            return NBT_EMEM;
 
-        case Z_DATA_ERROR: case Z_NEED_DICT:
-            goto decompression_error;
+        case Z_OK: case Z_BUF_ERROR:
+            /*
+             * If we're at the end of the input data, we'd sure as hell be at
+             * the end of the zlib stream.
+             */
+            if(stream->avail_out != 0)
+                return NBT_EZ;
+
+            if(buffer_reserve(&dec->out, dec->out.cap * 2))
+                return NBT_EMEM;
+            break;
 
         default:
-            /* update our buffer length to reflect the new data */
-            ret.len += CHUNK_SIZE - stream.avail_out;
+            return NBT_EZ;
         }
+    }
+}
 
-    } while(stream.avail_out == 0);
+#endif /* NBT_USE_LIBDEFLATE */
 
-    /*
-     * If we're at the end of the input data, we'd sure as hell be at the end
-     * of the zlib stream.
-     */
-    if(zlib_ret != Z_STREAM_END) goto decompression_error;
-    (void)inflateEnd(&stream);
+/*
+ * lz4-java's LZ4BlockOutputStream, which Minecraft uses for chunk compression
+ * scheme 4, writes a series of blocks, each with this header:
+ *
+ *   "LZ4Block"            magic, 8 bytes
+ *   token                 method (0x10 raw, 0x20 LZ4) | compression level
+ *   compressed length     int32, little endian
+ *   decompressed length   int32, little endian
+ *   checksum              int32, little endian, xxhash32 of the block
+ *
+ * The stream ends with an empty raw block. Blocks never decompress to more
+ * than 1 << (10 + compression level) bytes, which is at most 32 MiB.
+ */
+#define LZ4_BLOCK_MAGIC        "LZ4Block"
+#define LZ4_BLOCK_HEADER_SIZE  21
+#define LZ4_BLOCK_METHOD_RAW   0x10
+#define LZ4_BLOCK_METHOD_LZ4   0x20
+#define LZ4_BLOCK_LEVEL_BASE   10
 
-    return ret;
+static uint32_t read_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
 
-decompression_error:
-    if(errno == NBT_OK)
-        errno = NBT_EZ;
+/*
+ * Reads a LZ4 length extension: bytes are added to `len' for as long as they
+ * are 255. Returns non-zero if the input runs out first.
+ */
+static int lz4_read_length(const unsigned char** ip, const unsigned char* iend, size_t* len)
+{
+    unsigned char b;
 
-    (void)inflateEnd(&stream);
+    do {
+        if(*ip >= iend) return 1;
+        b = *(*ip)++;
+        *len += b;
+    } while(b == 255);
 
-    buffer_free(&ret);
-    return BUFFER_INIT;
+    return 0;
+}
+
+/*
+ * Decodes a single raw LZ4 block of `len' bytes into exactly `out_len' bytes
+ * at `out'. Returns non-zero if the block is corrupt.
+ */
+static int lz4_decode_block(const unsigned char* in, size_t len, unsigned char* out, size_t out_len)
+{
+    const unsigned char* ip   = in;
+    const unsigned char* iend = in + len;
+    unsigned char* op         = out;
+    unsigned char* oend       = out + out_len;
+
+    while(ip < iend)
+    {
+        unsigned char token = *ip++;
+
+        size_t literals = token >> 4;
+        if(literals == 15 && lz4_read_length(&ip, iend, &literals)) return 1;
+
+        if((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals) return 1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        /* the last sequence only has literals */
+        if(ip == iend) break;
+
+        if(iend - ip < 2) return 1;
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if(offset == 0 || offset > (size_t)(op - out)) return 1;
+
+        size_t match = token & 15;
+        if(match == 15 && lz4_read_length(&ip, iend, &match)) return 1;
+        match += 4;
+
+        if((size_t)(oend - op) < match) return 1;
+
+        /* matches may overlap their own output, so copy byte by byte then */
+        const unsigned char* from = op - offset;
+        if(offset >= match)
+            memcpy(op, from, match);
+        else
+            for(size_t i = 0; i < match; i++) op[i] = from[i];
+        op += match;
+    }
+
+    return op == oend ? 0 : 1;
+}
+
+static nbt_status decompress_lz4_into(struct nbt_decompressor* dec, const void* mem, size_t len)
+{
+    const unsigned char* ip   = mem;
+    const unsigned char* iend = ip + len;
+
+    dec->out.len = 0;
+
+    for(;;)
+    {
+        if((size_t)(iend - ip) < LZ4_BLOCK_HEADER_SIZE) return NBT_EZ;
+        if(memcmp(ip, LZ4_BLOCK_MAGIC, 8) != 0)         return NBT_EZ;
+
+        unsigned char method     = ip[8] & 0xf0;
+        uint32_t max_len         = (uint32_t)1 << (LZ4_BLOCK_LEVEL_BASE + (ip[8] & 0x0f));
+        uint32_t compressed_len  = read_le32(ip + 9);
+        uint32_t original_len    = read_le32(ip + 13);
+        ip += LZ4_BLOCK_HEADER_SIZE;
+
+        if(original_len == 0) return NBT_OK; /* end of stream marker */
+
+        if(original_len > max_len)               return NBT_EZ;
+        if(compressed_len > (size_t)(iend - ip)) return NBT_EZ;
+
+        if(buffer_reserve(&dec->out, dec->out.len + original_len))
+            return NBT_EMEM;
+
+        unsigned char* op = dec->out.data + dec->out.len;
+
+        if(method == LZ4_BLOCK_METHOD_RAW)
+        {
+            if(compressed_len != original_len) return NBT_EZ;
+            memcpy(op, ip, original_len);
+        }
+        else if(method == LZ4_BLOCK_METHOD_LZ4)
+        {
+            if(lz4_decode_block(ip, compressed_len, op, original_len)) return NBT_EZ;
+        }
+        else
+            return NBT_EZ;
+
+        ip += compressed_len;
+        dec->out.len += original_len;
+    }
+}
+
+/*
+ * Reads in zlib- or gzip-compressed data, and returns a buffer with the
+ * decompressed data within. Returns a NULL buffer on failure, and sets errno
+ * appropriately.
+ */
+static struct buffer __decompress(const void* mem, size_t len)
+{
+    struct nbt_decompressor dec;
+
+    if((errno = decompressor_init(&dec)) != NBT_OK)
+        return BUFFER_INIT;
+
+    errno = decompress_into(&dec, mem, len);
+
+    /* steal the output buffer, so it survives the decompressor */
+    struct buffer ret = dec.out;
+    dec.out = BUFFER_INIT;
+
+    decompressor_destroy(&dec);
+
+    if(errno != NBT_OK)
+        return buffer_free(&ret), BUFFER_INIT;
+
+    return ret;
 }
 
 /*
@@ -264,6 +543,62 @@ nbt_node* nbt_parse_compressed(const void* chunk_start, size_t length)
     return ret;
 }
 
+struct nbt_decompressor* nbt_decompressor_new(void)
+{
+    struct nbt_decompressor* dec = malloc(sizeof *dec);
+
+    if(dec == NULL)
+        return (errno = NBT_EMEM), NULL;
+
+    if((errno = decompressor_init(dec)) != NBT_OK)
+        return free(dec), NULL;
+
+    return dec;
+}
+
+void nbt_decompressor_free(struct nbt_decompressor* dec)
+{
+    if(dec == NULL) return;
+
+    decompressor_destroy(dec);
+    free(dec);
+}
+
+const void* nbt_decompress(struct nbt_decompressor* dec, const void* mem, size_t len, size_t* out_length)
+{
+    assert(dec);
+    assert(out_length);
+
+    if((errno = decompress_into(dec, mem, len)) != NBT_OK)
+        return NULL;
+
+    *out_length = dec->out.len;
+    return dec->out.data;
+}
+
+const void* nbt_decompress_lz4(struct nbt_decompressor* dec, const void* mem, size_t len, size_t* out_length)
+{
+    assert(dec);
+    assert(out_length);
+
+    if((errno = decompress_lz4_into(dec, mem, len)) != NBT_OK)
+        return NULL;
+
+    *out_length = dec->out.len;
+    return dec->out.data;
+}
+
+nbt_node* nbt_parse_compressed_with(struct nbt_decompressor* dec, const void* chunk_start, size_t length)
+{
+    size_t decompressed_length;
+    const void* decompressed = nbt_decompress(dec, chunk_start, length, &decompressed_length);
+
+    if(decompressed == NULL)
+        return NULL;
+
+    return nbt_parse(decompressed, decompressed_length);
+}
+
 /*
  * Once again, all we're doing is handing the actual compression off to
  * nbt_dump_compressed, then dumping it into the file.
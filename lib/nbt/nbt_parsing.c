@@ -9,8 +9,10 @@
  */
 #include "nbt.h"
 
+#include "arena.h"
 #include "buffer.h"
-#include "list.h"
+#include "byteswap.h"
+#include "scanning.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -72,6 +74,19 @@ static const void* swapped_memscan(void* dest, const void* src, size_t n)
     return be2ne(dest, n), ret;
 }
 
+/* memscans of whole int and long arrays, converted to native endian in bulk */
+static const void* int_array_memscan(void* dest, const void* src, size_t n)
+{
+    be32_to_ne_array(dest, src, n / sizeof(int32_t));
+    return (const char*)src + n;
+}
+
+static const void* long_array_memscan(void* dest, const void* src, size_t n)
+{
+    be64_to_ne_array(dest, src, n / sizeof(int64_t));
+    return (const char*)src + n;
+}
+
 #define CHECKED_MALLOC(var, n, on_error) do { \
     if((var = malloc(n)) == NULL)             \
     {                                         \
@@ -80,13 +95,103 @@ static const void* swapped_memscan(void* dest, const void* src, size_t n)
     }                                         \
 } while(0)
 
+/*
+ * The same as CHECKED_MALLOC, but allocates from `arena' when parsing into
+ * one, and from the heap otherwise.
+ */
+#define ARENA_MALLOC(arena, var, n, on_error) do {                          \
+    if((var = (arena) ? nbt_arena_alloc((arena), (n)) : malloc(n)) == NULL) \
+    {                                                                       \
+        errno = NBT_EMEM;                                                   \
+        on_error;                                                           \
+    }                                                                       \
+} while(0)
+
+/* one bit of path_match.live per path */
+#define MAX_PARSE_PATHS 64
+
+struct parse_opts {
+    struct nbt_arena* arena; /* NULL to allocate from the heap */
+    bool borrow_arrays;      /* point arrays into the parsed memory instead of copying them */
+    const char* const* paths; /* NULL-terminated paths to keep, NULL to keep everything */
+};
+
+/*
+ * How far the path of a tag got into opts->paths. Every path still being
+ * followed has its bit set in `live', and they all match the first `offset'
+ * characters, since those spell out the path to this tag. Everything under a
+ * tag with `all' set is kept.
+ */
+struct path_match {
+    bool all;
+    uint64_t live;
+    size_t offset;
+};
+
+/* Does `path' go on with a segment called `name'? */
+static bool path_segment_is(const char* path, const char* name, size_t name_length)
+{
+    for(size_t i = 0; i < name_length; i++)
+        if(path[i] == '\0' || path[i] != name[i]) return false;
+
+    return path[name_length] == '\0' || path[name_length] == '.';
+}
+
+/*
+ * Works out which paths go on through a child called `name' of a tag matched
+ * by `parent'. List items are children with an empty name. Returns false if
+ * none do, and the child should be skipped.
+ */
+static bool match_child(const struct parse_opts* opts, const struct path_match* parent,
+                        const char* name, size_t name_length, struct path_match* child)
+{
+    if(parent->all)
+    {
+        *child = *parent;
+        return true;
+    }
+
+    child->all    = false;
+    child->live   = 0;
+    child->offset = parent->offset + name_length + 1;
+
+    for(size_t i = 0; opts->paths[i] != NULL; i++)
+    {
+        const char* rest = opts->paths[i] + parent->offset;
+
+        if(!(parent->live >> i & 1) || !path_segment_is(rest, name, name_length)) continue;
+
+        if(rest[name_length] == '\0')
+        {
+            child->all = true;
+            return true;
+        }
+
+        child->live |= (uint64_t)1 << i;
+    }
+
+    return child->live != 0;
+}
+
+/* Memory from an arena is only ever given back all at once. */
+static void release(struct nbt_arena* arena, void* ptr)
+{
+    if(arena == NULL) free(ptr);
+}
+
+static void release_list(struct nbt_arena* arena, struct nbt_list* list)
+{
+    if(arena == NULL) nbt_free_list(list);
+}
+
 #define CHECKED_APPEND(b, ptr, len) do { \
     if(buffer_append((b), (ptr), (len))) \
         return NBT_EMEM;                 \
 } while(0)
 
 /* Parses a tag, given a name (may be NULL) and a type. Fills in the payload. */
-static nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memory, size_t* length);
+static nbt_node* parse_unnamed_tag(const struct parse_opts* opts, const struct path_match* match,
+                                   nbt_type type, char* name, const char** memory, size_t* length);
 
 /*
  * Reads some bytes from the memory stream. This macro will read `n'
@@ -123,7 +228,7 @@ static void bprintf(struct buffer* b, const char* restrict format, ...)
  * Reads a string from memory, moving the pointer and updating the length
  * appropriately. Returns NULL on failure.
  */
-static char* read_string(const char** memory, size_t* length)
+static char* read_string(const struct parse_opts* opts, const char** memory, size_t* length)
 {
     int16_t string_length;
     char* ret = NULL;
@@ -133,7 +238,7 @@ static char* read_string(const char** memory, size_t* length)
     if(string_length < 0)               goto parse_error;
     if(*length < (size_t)string_length) goto parse_error;
 
-    CHECKED_MALLOC(ret, string_length + 1, goto parse_error);
+    ARENA_MALLOC(opts->arena, ret, string_length + 1, goto parse_error);
 
     READ_GENERIC(ret, (size_t)string_length, memscan, goto parse_error);
 
@@ -144,20 +249,51 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    free(ret);
+    release(opts->arena, ret);
     return NULL;
 }
 
-static nbt_node* parse_named_tag(const char** memory, size_t* length)
+/* Looks at the length of the string at `memory' without moving past it. */
+static bool peek_string_length(const char* memory, size_t length, size_t* string_length)
+{
+    if(length < 2) return false;
+
+    *string_length = (size_t)((unsigned char)memory[0] << 8 | (unsigned char)memory[1]);
+    return *string_length <= INT16_MAX && length - 2 >= *string_length;
+}
+
+/*
+ * Reads a tag name like read_string. In an arena the name is interned, so
+ * every tree in it shares the same copy.
+ */
+static char* read_name(const struct parse_opts* opts, const char** memory, size_t* length)
+{
+    size_t name_length;
+    char* ret;
+
+    if(opts->arena == NULL
+       || !peek_string_length(*memory, *length, &name_length)
+       || (ret = nbt_arena_intern_n(opts->arena, *memory + 2, name_length)) == NULL)
+        return read_string(opts, memory, length);
+
+    *memory += 2 + name_length;
+    *length -= 2 + name_length;
+    return ret;
+}
+
+static nbt_node* parse_named_tag(const struct parse_opts* opts, const char** memory, size_t* length)
 {
   char* name = NULL;
 
+  /* the root is always kept, the paths start below it */
+  struct path_match match = { .all = opts->paths == NULL, .live = UINT64_MAX, .offset = 0 };
+
   uint8_t type;
   READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
 
-  name = read_string(memory, length);
+  name = read_name(opts, memory, length);
 
-  nbt_node* ret = parse_unnamed_tag((nbt_type)type, name, memory, length);
+  nbt_node* ret = parse_unnamed_tag(opts, &match, (nbt_type)type, name, memory, length);
   if(ret == NULL) goto parse_error;
 
   return ret;
@@ -166,11 +302,11 @@ parse_error:
   if(errno == NBT_OK)
     errno = NBT_ERR;
 
-  free(name);
+  release(opts->arena, name);
   return NULL;
 }
 
-static struct nbt_byte_array read_byte_array(const char** memory, size_t* length)
+static struct nbt_byte_array read_byte_array(const struct parse_opts* opts, const char** memory, size_t* length)
 {
     struct nbt_byte_array ret;
     ret.data = NULL;
@@ -179,7 +315,17 @@ static struct nbt_byte_array read_byte_array(const char** memory, size_t* length
 
     if(ret.length < 0) goto parse_error;
 
-    CHECKED_MALLOC(ret.data, ret.length, goto parse_error);
+    if(opts->borrow_arrays)
+    {
+        if(*length < (size_t)ret.length) goto parse_error;
+
+        ret.data = (unsigned char*)*memory;
+        *memory += ret.length;
+        *length -= ret.length;
+        return ret;
+    }
+
+    ARENA_MALLOC(opts->arena, ret.data, ret.length, goto parse_error);
 
     READ_GENERIC(ret.data, (size_t)ret.length, memscan, goto parse_error);
 
@@ -189,28 +335,36 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    free(ret.data);
+    release(opts->arena, ret.data);
     ret.data = NULL;
     return ret;
 }
 
-static struct nbt_int_array read_int_array(const char** memory, size_t* length)
+static struct nbt_int_array read_int_array(const struct parse_opts* opts, const char** memory, size_t* length)
 {
     struct nbt_int_array ret;
     ret.data = NULL;
+    ret.big_endian = false;
 
     READ_GENERIC(&ret.length, sizeof ret.length, swapped_memscan, goto parse_error);
 
     if(ret.length < 0) goto parse_error;
 
-    CHECKED_MALLOC(ret.data, ret.length * sizeof(int32_t), goto parse_error);
+    /* left in file order, nbt_int_array_get swaps on access */
+    if(opts->borrow_arrays)
+    {
+        if(*length / sizeof(int32_t) < (size_t)ret.length) goto parse_error;
 
-    READ_GENERIC(ret.data, (size_t)ret.length * sizeof(int32_t), memscan, goto parse_error);
+        ret.data = (int32_t*)(void*)*memory;
+        ret.big_endian = true;
+        *memory += (size_t)ret.length * sizeof(int32_t);
+        *length -= (size_t)ret.length * sizeof(int32_t);
+        return ret;
+    }
 
+    ARENA_MALLOC(opts->arena, ret.data, ret.length * sizeof(int32_t), goto parse_error);
 
-    // Byteswap the whole array.
-    for(int32_t i = 0; i < ret.length; i++)
-        be2ne(ret.data + i, sizeof(int32_t));
+    READ_GENERIC(ret.data, (size_t)ret.length * sizeof(int32_t), int_array_memscan, goto parse_error);
 
     return ret;
 
@@ -218,28 +372,36 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    free(ret.data);
+    release(opts->arena, ret.data);
     ret.data = NULL;
     return ret;
 }
 
-static struct nbt_long_array read_long_array(const char** memory, size_t* length)
+static struct nbt_long_array read_long_array(const struct parse_opts* opts, const char** memory, size_t* length)
 {
     struct nbt_long_array ret;
     ret.data = NULL;
+    ret.big_endian = false;
 
     READ_GENERIC(&ret.length, sizeof ret.length, swapped_memscan, goto parse_error);
 
     if(ret.length < 0) goto parse_error;
 
-    CHECKED_MALLOC(ret.data, ret.length * sizeof(int64_t), goto parse_error);
+    /* left in file order, nbt_long_array_get swaps on access */
+    if(opts->borrow_arrays)
+    {
+        if(*length / sizeof(int64_t) < (size_t)ret.length) goto parse_error;
 
-    READ_GENERIC(ret.data, (size_t)ret.length * sizeof(int64_t), memscan, goto parse_error);
+        ret.data = (int64_t*)(void*)*memory;
+        ret.big_endian = true;
+        *memory += (size_t)ret.length * sizeof(int64_t);
+        *length -= (size_t)ret.length * sizeof(int64_t);
+        return ret;
+    }
 
+    ARENA_MALLOC(opts->arena, ret.data, ret.length * sizeof(int64_t), goto parse_error);
 
-    // Byteswap the whole array.
-    for(int64_t i = 0; i < ret.length; i++)
-        be2ne(ret.data + i, sizeof(int64_t));
+    READ_GENERIC(ret.data, (size_t)ret.length * sizeof(int64_t), long_array_memscan, goto parse_error);
 
     return ret;
 
@@ -247,7 +409,7 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    free(ret.data);
+    release(opts->arena, ret.data);
     ret.data = NULL;
     return ret;
 }
@@ -260,65 +422,121 @@ static nbt_type list_is_homogenous(const struct nbt_list* list)
 {
     nbt_type type = TAG_INVALID;
 
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
     {
-        const struct nbt_list* cur = list_entry(pos, const struct nbt_list, entry);
+        const nbt_node* cur = *pos;
 
-        assert(cur->data);
-        assert(cur->data->type != TAG_INVALID);
+        assert(cur);
+        assert(cur->type != TAG_INVALID);
 
-        if(cur->data->type == TAG_INVALID)
+        if(cur->type == TAG_INVALID)
             return TAG_INVALID;
 
         /* if we're the first type, just set it to our current type */
-        if(type == TAG_INVALID) type = cur->data->type;
+        if(type == TAG_INVALID) type = cur->type;
 
-        if(type != cur->data->type)
+        if(type != cur->type)
             return TAG_INVALID;
     }
 
-    /* if the list was empty, use the sentinel type */
-    if(type == TAG_INVALID && list->data != NULL)
-        type = list->data->type;
+    /* if the list was empty, use the type it was read with */
+    if(type == TAG_INVALID)
+        type = list->type;
 
     return type;
 }
 
-static struct nbt_list* read_list(const char** memory, size_t* length)
+/*
+ * Allocates an empty list with room for `capacity' children. `items' is
+ * never NULL, not even for empty lists.
+ */
+static struct nbt_list* new_list(const struct parse_opts* opts, size_t capacity, nbt_type type)
 {
-    uint8_t type;
-    int32_t elems;
     struct nbt_list* ret;
 
-    CHECKED_MALLOC(ret, sizeof *ret, goto parse_error);
+    if(capacity == 0) capacity = 1;
+
+    ARENA_MALLOC(opts->arena, ret, sizeof *ret, return NULL);
+    ARENA_MALLOC(opts->arena, ret->items, capacity * sizeof *ret->items,
+        release(opts->arena, ret);
+        return NULL;
+    );
 
-    /* we allocate the data pointer to store the type of the list in the first
-     * sentinel element */
-    CHECKED_MALLOC(ret->data, sizeof *ret->data, goto parse_error);
+    ret->length   = 0;
+    ret->capacity = capacity;
+    ret->type     = type;
 
-    INIT_LIST_HEAD(&ret->entry);
+    return ret;
+}
+
+/* Doubles the room for children. Returns non-zero if out of memory. */
+static int grow_list(const struct parse_opts* opts, struct nbt_list* list)
+{
+    size_t capacity = list->capacity * 2;
+    nbt_node** items;
+
+    if(opts->arena == NULL)
+    {
+        items = realloc(list->items, capacity * sizeof *items);
+    }
+    else
+    {
+        /* the old array stays behind in the arena until it's reset */
+        items = nbt_arena_alloc(opts->arena, capacity * sizeof *items);
+        if(items != NULL)
+            memcpy(items, list->items, list->length * sizeof *items);
+    }
+
+    if(items == NULL)
+    {
+        errno = NBT_EMEM;
+        return 1;
+    }
+
+    list->items    = items;
+    list->capacity = capacity;
+
+    return 0;
+}
+
+static struct nbt_list* read_list(const struct parse_opts* opts, const struct path_match* match,
+                                  const char** memory, size_t* length)
+{
+    uint8_t type;
+    int32_t elems;
+    struct nbt_list* ret = NULL;
 
     READ_GENERIC(&type, sizeof type, swapped_memscan, goto parse_error);
     READ_GENERIC(&elems, sizeof elems, swapped_memscan, goto parse_error);
 
-    ret->data->type = type == TAG_INVALID ? TAG_COMPOUND : (nbt_type)type;
+    if(elems < 0) elems = 0;
 
-    for(int32_t i = 0; i < elems; i++)
+    /* every element takes at least a byte, so don't believe any more than that */
+    if((size_t)elems > *length) goto parse_error;
+
+    /* a list no path goes into is kept, but left empty */
+    struct path_match item;
+    if(!match_child(opts, match, "", 0, &item))
     {
-        struct nbt_list* new;
+        for(int32_t i = 0; i < elems; i++)
+            if(nbt_skip_payload((nbt_type)type, memory, length) != NBT_OK)
+                goto parse_error;
 
-        CHECKED_MALLOC(new, sizeof *new, goto parse_error);
+        elems = 0;
+    }
 
-        new->data = parse_unnamed_tag((nbt_type)type, NULL, memory, length);
+    ret = new_list(opts, (size_t)elems, type == TAG_INVALID ? TAG_COMPOUND : (nbt_type)type);
+    if(ret == NULL) goto parse_error;
 
-        if(new->data == NULL)
-        {
-            free(new);
+    for(int32_t i = 0; i < elems; i++)
+    {
+        nbt_node* new = parse_unnamed_tag(opts, &item, (nbt_type)type, NULL, memory, length);
+
+        if(new == NULL)
             goto parse_error;
-        }
 
-        list_add_tail(&new->entry, &ret->entry);
+        ret->items[ret->length++] = new;
     }
 
     return ret;
@@ -327,47 +545,57 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    nbt_free_list(ret);
+    release_list(opts->arena, ret);
     return NULL;
 }
 
-static struct nbt_list* read_compound(const char** memory, size_t* length)
+static struct nbt_list* read_compound(const struct parse_opts* opts, const struct path_match* match,
+                                      const char** memory, size_t* length)
 {
-    struct nbt_list* ret;
-
-    CHECKED_MALLOC(ret, sizeof *ret, goto parse_error);
-
-    ret->data = NULL;
-    INIT_LIST_HEAD(&ret->entry);
+    struct nbt_list* ret = new_list(opts, 8, TAG_INVALID);
+    if(ret == NULL) goto parse_error;
 
     for(;;)
     {
         uint8_t type;
         char* name = NULL;
-        struct nbt_list* new_entry;
 
         READ_GENERIC(&type, sizeof type, swapped_memscan, goto parse_error);
 
         if(type == 0) break; /* TAG_END == 0. We've hit the end of the list when type == TAG_END. */
 
-        name = read_string(memory, length);
+        /* look at the name in place first, so that skipped tags allocate nothing */
+        struct path_match child;
+        size_t name_length;
+        if(!peek_string_length(*memory, *length, &name_length)) goto parse_error;
+
+        if(!match_child(opts, match, *memory + 2, name_length, &child))
+        {
+            *memory += 2 + name_length;
+            *length -= 2 + name_length;
+
+            if(nbt_skip_payload((nbt_type)type, memory, length) != NBT_OK) goto parse_error;
+            continue;
+        }
+
+        name = read_name(opts, memory, length);
         if(name == NULL) goto parse_error;
 
-        CHECKED_MALLOC(new_entry, sizeof *new_entry,
-            free(name);
+        if(ret->length == ret->capacity && grow_list(opts, ret))
+        {
+            release(opts->arena, name);
             goto parse_error;
-        );
+        }
 
-        new_entry->data = parse_unnamed_tag((nbt_type)type, name, memory, length);
+        nbt_node* new = parse_unnamed_tag(opts, &child, (nbt_type)type, name, memory, length);
 
-        if(new_entry->data == NULL)
+        if(new == NULL)
         {
-            free(new_entry);
-            free(name);
+            release(opts->arena, name);
             goto parse_error;
         }
 
-        list_add_tail(&new_entry->entry, &ret->entry);
+        ret->items[ret->length++] = new;
     }
 
     return ret;
@@ -375,7 +603,7 @@ static struct nbt_list* read_compound(const char** memory, size_t* length)
 parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
-    nbt_free_list(ret);
+    release_list(opts->arena, ret);
 
     return NULL;
 }
@@ -383,11 +611,12 @@ parse_error:
 /*
  * Parses a tag, given a name (may be NULL) and a type. Fills in the payload.
  */
-static nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memory, size_t* length)
+static nbt_node* parse_unnamed_tag(const struct parse_opts* opts, const struct path_match* match,
+                                   nbt_type type, char* name, const char** memory, size_t* length)
 {
     nbt_node* node;
 
-    CHECKED_MALLOC(node, sizeof *node, goto parse_error);
+    ARENA_MALLOC(opts->arena, node, sizeof *node, goto parse_error);
 
     node->type = type;
     node->name = name;
@@ -416,22 +645,22 @@ static nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memor
         COPY_INTO_PAYLOAD(tag_double);
         break;
     case TAG_BYTE_ARRAY:
-        node->payload.tag_byte_array = read_byte_array(memory, length);
+        node->payload.tag_byte_array = read_byte_array(opts, memory, length);
         break;
     case TAG_INT_ARRAY:
-        node->payload.tag_int_array = read_int_array(memory, length);
+        node->payload.tag_int_array = read_int_array(opts, memory, length);
         break;
     case TAG_LONG_ARRAY:
-        node->payload.tag_long_array = read_long_array(memory, length);
+        node->payload.tag_long_array = read_long_array(opts, memory, length);
         break;
     case TAG_STRING:
-        node->payload.tag_string = read_string(memory, length);
+        node->payload.tag_string = read_string(opts, memory, length);
         break;
     case TAG_LIST:
-        node->payload.tag_list = read_list(memory, length);
+        node->payload.tag_list = read_list(opts, match, memory, length);
         break;
     case TAG_COMPOUND:
-        node->payload.tag_compound = read_compound(memory, length);
+        node->payload.tag_compound = read_compound(opts, match, memory, length);
         break;
 
     default:
@@ -448,7 +677,7 @@ parse_error:
     if(errno == NBT_OK)
         errno = NBT_ERR;
 
-    free(node);
+    release(opts->arena, node);
     return NULL;
 }
 
@@ -459,7 +688,56 @@ nbt_node* nbt_parse(const void* mem, size_t len)
     const char** memory = (const char**)&mem;
     size_t* length = &len;
 
-    return parse_named_tag(memory, length);
+    const struct parse_opts opts = { .arena = NULL, .borrow_arrays = false, .paths = NULL };
+    return parse_named_tag(&opts, memory, length);
+}
+
+nbt_node* nbt_parse_arena(struct nbt_arena* arena, const void* mem, size_t len)
+{
+    assert(arena);
+
+    errno = NBT_OK;
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    const struct parse_opts opts = { .arena = arena, .borrow_arrays = false, .paths = NULL };
+    return parse_named_tag(&opts, memory, length);
+}
+
+nbt_node* nbt_parse_borrowed(struct nbt_arena* arena, const void* mem, size_t len)
+{
+    assert(arena);
+
+    errno = NBT_OK;
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    const struct parse_opts opts = { .arena = arena, .borrow_arrays = true, .paths = NULL };
+    return parse_named_tag(&opts, memory, length);
+}
+
+nbt_node* nbt_parse_paths(struct nbt_arena* arena, const void* mem, size_t len, const char* const* paths)
+{
+    assert(arena);
+    assert(paths);
+
+    size_t count = 0;
+    while(paths[count] != NULL) count++;
+    if(count > MAX_PARSE_PATHS)
+    {
+        errno = NBT_ERR;
+        return NULL;
+    }
+
+    errno = NBT_OK;
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    const struct parse_opts opts = { .arena = arena, .borrow_arrays = true, .paths = paths };
+    return parse_named_tag(&opts, memory, length);
 }
 
 /* spaces, not tabs ;) */
@@ -497,7 +775,7 @@ static void dump_int_array(const struct nbt_int_array ia, struct buffer* b)
 
     bprintf(b, "[ ");
     for(int32_t i = 0; i < ia.length; ++i)
-        bprintf(b, "%u ", +ia.data[i]);
+        bprintf(b, "%u ", +nbt_int_array_get(&ia, i));
     bprintf(b, "]");
 }
 
@@ -507,20 +785,19 @@ static void dump_long_array(const struct nbt_long_array ia, struct buffer* b)
 
     bprintf(b, "[ ");
     for(int32_t i = 0; i < ia.length; ++i)
-        bprintf(b, "%u ", +ia.data[i]);
+        bprintf(b, "%u ", +nbt_long_array_get(&ia, i));
     bprintf(b, "]");
 }
 
 static nbt_status dump_list_contents_ascii(const struct nbt_list* list, struct buffer* b, size_t ident)
 {
-    const struct list_head* pos;
+    nbt_node** pos;
 
-    list_for_each(pos, &list->entry)
+    nbt_list_for_each(pos, list)
     {
-        const struct nbt_list* entry = list_entry(pos, const struct nbt_list, entry);
         nbt_status err;
 
-        if((err = __nbt_dump_ascii(entry->data, b, ident)) != NBT_OK)
+        if((err = __nbt_dump_ascii(*pos, b, ident)) != NBT_OK)
             return err;
     }
 
@@ -572,7 +849,7 @@ static nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b, size_
     }
     else if(tree->type == TAG_LIST)
     {
-        bprintf(b, "TAG_List(\"%s\") [%s]\n", SAFE_NAME(tree), nbt_type_to_string(tree->payload.tag_list->data->type));
+        bprintf(b, "TAG_List(\"%s\") [%s]\n", SAFE_NAME(tree), nbt_type_to_string(tree->payload.tag_list->type));
         indent(b, ident);
         bprintf(b, "{\n");
 
@@ -656,7 +933,7 @@ static nbt_status dump_int_array_binary(const struct nbt_int_array ia, struct bu
 
     for(int32_t i = 0; i < ia.length; i++)
     {
-        int32_t swappedElem = ia.data[i];
+        int32_t swappedElem = nbt_int_array_get(&ia, i);
         ne2be(&swappedElem, sizeof(swappedElem));
         CHECKED_APPEND(b, &swappedElem, sizeof(swappedElem));
     }
@@ -676,7 +953,7 @@ static nbt_status dump_long_array_binary(const struct nbt_long_array ia, struct
 
     for(int32_t i = 0; i < ia.length; i++)
     {
-        int64_t swappedElem = ia.data[i];
+        int64_t swappedElem = nbt_long_array_get(&ia, i);
         ne2be(&swappedElem, sizeof(swappedElem));
         CHECKED_APPEND(b, &swappedElem, sizeof(swappedElem));
     }
@@ -711,7 +988,7 @@ static nbt_status dump_list_binary(const struct nbt_list* list, struct buffer* b
 {
     nbt_type type = list_is_homogenous(list);
 
-    size_t len = list_length(&list->entry);
+    size_t len = list->length;
 
     if(len > 2147483647 /* INT_MAX */)
         return NBT_ERR;
@@ -733,13 +1010,12 @@ static nbt_status dump_list_binary(const struct nbt_list* list, struct buffer* b
         CHECKED_APPEND(b, &dumped_len, sizeof dumped_len);
     }
 
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
     {
-        const struct nbt_list* entry = list_entry(pos, const struct nbt_list, entry);
         nbt_status ret;
 
-        if((ret = __dump_binary(entry->data, false, b)) != NBT_OK)
+        if((ret = __dump_binary(*pos, false, b)) != NBT_OK)
             return ret;
     }
 
@@ -748,13 +1024,12 @@ static nbt_status dump_list_binary(const struct nbt_list* list, struct buffer* b
 
 static nbt_status dump_compound_binary(const struct nbt_list* list, struct buffer* b)
 {
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
     {
-        const struct nbt_list* entry = list_entry(pos, const struct nbt_list, entry);
         nbt_status ret;
 
-        if((ret = __dump_binary(entry->data, true, b)) != NBT_OK)
+        if((ret = __dump_binary(*pos, true, b)) != NBT_OK)
             return ret;
     }
 
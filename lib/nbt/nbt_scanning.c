@@ -0,0 +1,362 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+#include "scanning.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Returned internally when a callback asked to stop. Not an nbt_status. */
+#define SCAN_STOPPED 1
+
+struct scanner {
+    const unsigned char* start;
+    const unsigned char* p;
+    const unsigned char* end;
+
+    const struct nbt_scan_callbacks* callbacks;
+    void* aux;
+};
+
+static uint16_t load_be16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t load_be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t load_be64(const unsigned char* p)
+{
+    return (uint64_t)load_be32(p) << 32 | load_be32(p + 4);
+}
+
+static size_t remaining(const struct scanner* s)
+{
+    return (size_t)(s->end - s->p);
+}
+
+/* The size of a payload that has no length prefix, 0 for the other types. */
+static size_t fixed_payload_size(nbt_type type)
+{
+    switch(type)
+    {
+    case TAG_BYTE:   return 1;
+    case TAG_SHORT:  return 2;
+    case TAG_INT:    return 4;
+    case TAG_LONG:   return 8;
+    case TAG_FLOAT:  return 4;
+    case TAG_DOUBLE: return 8;
+    default:         return 0;
+    }
+}
+
+/* Reads an array length prefix, and checks `elem_size' times that many bytes follow. */
+static int read_array_length(struct scanner* s, size_t elem_size, int32_t* length)
+{
+    if(remaining(s) < 4) return NBT_ERR;
+
+    *length = (int32_t)load_be32(s->p);
+    s->p += 4;
+
+    if(*length < 0)                                      return NBT_ERR;
+    if((size_t)*length > remaining(s) / elem_size)       return NBT_ERR;
+
+    return NBT_OK;
+}
+
+static int read_string_header(struct scanner* s, const char** data, size_t* length)
+{
+    if(remaining(s) < 2) return NBT_ERR;
+
+    *length = load_be16(s->p);
+    s->p += 2;
+
+    if(*length > remaining(s)) return NBT_ERR;
+
+    *data = (const char*)s->p;
+    s->p += *length;
+
+    return NBT_OK;
+}
+
+/*
+ * Moves past a payload without telling anyone about it. Lists of fixed size
+ * elements are skipped in one go, only compounds and lists of variable sized
+ * elements have to be walked.
+ */
+static int skip_payload(struct scanner* s, nbt_type type, int depth)
+{
+    if(depth > NBT_SCAN_MAX_DEPTH) return NBT_ERR;
+
+    size_t size = fixed_payload_size(type);
+    if(size != 0)
+    {
+        if(remaining(s) < size) return NBT_ERR;
+        s->p += size;
+        return NBT_OK;
+    }
+
+    int32_t length;
+    int err;
+    const char* str;
+    size_t str_length;
+
+    switch(type)
+    {
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+        size = type == TAG_BYTE_ARRAY ? 1 : type == TAG_INT_ARRAY ? 4 : 8;
+        if((err = read_array_length(s, size, &length)) != NBT_OK) return err;
+        s->p += (size_t)length * size;
+        return NBT_OK;
+
+    case TAG_STRING:
+        return read_string_header(s, &str, &str_length);
+
+    case TAG_LIST:
+    {
+        if(remaining(s) < 5) return NBT_ERR;
+
+        nbt_type elem_type = (nbt_type)s->p[0];
+        length = (int32_t)load_be32(s->p + 1);
+        s->p += 5;
+
+        if(length <= 0) return NBT_OK;
+
+        size = fixed_payload_size(elem_type);
+        if(size != 0)
+        {
+            if((size_t)length > remaining(s) / size) return NBT_ERR;
+            s->p += (size_t)length * size;
+            return NBT_OK;
+        }
+
+        for(int32_t i = 0; i < length; i++)
+            if((err = skip_payload(s, elem_type, depth + 1)) != NBT_OK) return err;
+
+        return NBT_OK;
+    }
+
+    case TAG_COMPOUND:
+        for(;;)
+        {
+            if(remaining(s) < 1) return NBT_ERR;
+
+            nbt_type child_type = (nbt_type)*s->p++;
+            if(child_type == TAG_INVALID) return NBT_OK;
+
+            if((err = read_string_header(s, &str, &str_length)) != NBT_OK) return err;
+            if((err = skip_payload(s, child_type, depth + 1))  != NBT_OK) return err;
+        }
+
+    default:
+        return NBT_ERR; /* Unknown tag or TAG_END. */
+    }
+}
+
+/*
+ * Reads everything of a payload that fits in a struct nbt_scan_tag, which for
+ * lists is only their header and for compounds nothing at all.
+ */
+static int read_payload_head(struct scanner* s, struct nbt_scan_tag* tag)
+{
+    size_t size = fixed_payload_size(tag->type);
+    if(remaining(s) < size) return NBT_ERR;
+
+    switch(tag->type)
+    {
+    case TAG_BYTE:
+        tag->payload.tag_byte = (int8_t)s->p[0];
+        break;
+    case TAG_SHORT:
+        tag->payload.tag_short = (int16_t)load_be16(s->p);
+        break;
+    case TAG_INT:
+        tag->payload.tag_int = (int32_t)load_be32(s->p);
+        break;
+    case TAG_LONG:
+        tag->payload.tag_long = (int64_t)load_be64(s->p);
+        break;
+    case TAG_FLOAT:
+    {
+        uint32_t bits = load_be32(s->p);
+        memcpy(&tag->payload.tag_float, &bits, sizeof bits);
+        break;
+    }
+    case TAG_DOUBLE:
+    {
+        uint64_t bits = load_be64(s->p);
+        memcpy(&tag->payload.tag_double, &bits, sizeof bits);
+        break;
+    }
+
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+    {
+        size_t elem_size = tag->type == TAG_BYTE_ARRAY ? 1 : tag->type == TAG_INT_ARRAY ? 4 : 8;
+        int err = read_array_length(s, elem_size, &tag->payload.tag_array.length);
+        if(err != NBT_OK) return err;
+
+        tag->payload.tag_array.data = s->p;
+        s->p += (size_t)tag->payload.tag_array.length * elem_size;
+        break;
+    }
+
+    case TAG_STRING:
+        return read_string_header(s, &tag->payload.tag_string.data, &tag->payload.tag_string.length);
+
+    case TAG_LIST:
+        if(remaining(s) < 5) return NBT_ERR;
+
+        tag->payload.tag_list.type   = (nbt_type)s->p[0];
+        tag->payload.tag_list.length = (int32_t)load_be32(s->p + 1);
+        s->p += 5;
+
+        if(tag->payload.tag_list.length < 0) tag->payload.tag_list.length = 0;
+        if(tag->payload.tag_list.length > 0 && tag->payload.tag_list.type == TAG_INVALID)
+            return NBT_ERR;
+        break;
+
+    case TAG_COMPOUND:
+        break;
+
+    default:
+        return NBT_ERR; /* Unknown tag or TAG_END. */
+    }
+
+    s->p += size;
+    return NBT_OK;
+}
+
+static int scan_tag(struct scanner* s, nbt_type type, const char* name, size_t name_length,
+                    int32_t index, int depth)
+{
+    if(depth > NBT_SCAN_MAX_DEPTH) return NBT_ERR;
+
+    struct nbt_scan_tag tag;
+    tag.type        = type;
+    tag.name        = name;
+    tag.name_length = name_length;
+    tag.index       = index;
+    tag.depth       = depth;
+    tag.offset      = (size_t)(s->p - s->start);
+
+    int err = read_payload_head(s, &tag);
+    if(err != NBT_OK) return err;
+
+    nbt_scan_action action = NBT_SCAN_CONTINUE;
+    if(s->callbacks->enter != NULL)
+        action = s->callbacks->enter(&tag, s->aux);
+
+    if(action == NBT_SCAN_STOP) return SCAN_STOPPED;
+    if(type != TAG_LIST && type != TAG_COMPOUND) return NBT_OK;
+
+    if(action == NBT_SCAN_SKIP)
+    {
+        if(type == TAG_COMPOUND) return skip_payload(s, TAG_COMPOUND, depth);
+
+        for(int32_t i = 0; i < tag.payload.tag_list.length; i++)
+            if((err = skip_payload(s, tag.payload.tag_list.type, depth + 1)) != NBT_OK) return err;
+
+        return NBT_OK;
+    }
+
+    if(type == TAG_LIST)
+    {
+        for(int32_t i = 0; i < tag.payload.tag_list.length; i++)
+            if((err = scan_tag(s, tag.payload.tag_list.type, NULL, 0, i, depth + 1)) != NBT_OK) return err;
+    }
+    else
+    {
+        for(;;)
+        {
+            if(remaining(s) < 1) return NBT_ERR;
+
+            nbt_type child_type = (nbt_type)*s->p++;
+            if(child_type == TAG_INVALID) break;
+
+            const char* child_name;
+            size_t child_name_length;
+            if((err = read_string_header(s, &child_name, &child_name_length)) != NBT_OK) return err;
+            if((err = scan_tag(s, child_type, child_name, child_name_length, -1, depth + 1)) != NBT_OK) return err;
+        }
+    }
+
+    if(s->callbacks->leave != NULL && s->callbacks->leave(&tag, s->aux) == NBT_SCAN_STOP)
+        return SCAN_STOPPED;
+
+    return NBT_OK;
+}
+
+nbt_status nbt_scan(const void* mem, size_t len, const struct nbt_scan_callbacks* callbacks, void* aux)
+{
+    assert(callbacks);
+
+    struct scanner s;
+    s.start     = mem;
+    s.p         = s.start;
+    s.end       = s.p + len;
+    s.callbacks = callbacks;
+    s.aux       = aux;
+
+    int err = NBT_ERR;
+
+    if(remaining(&s) >= 1)
+    {
+        nbt_type type = (nbt_type)*s.p++;
+        const char* name;
+        size_t name_length;
+
+        err = read_string_header(&s, &name, &name_length);
+        if(err == NBT_OK)
+            err = scan_tag(&s, type, name, name_length, -1, 0);
+    }
+
+    if(err == SCAN_STOPPED) err = NBT_OK;
+    return (nbt_status)(errno = err);
+}
+
+bool nbt_scan_name_is(const struct nbt_scan_tag* tag, const char* name)
+{
+    assert(tag);
+    assert(name);
+
+    size_t length = strlen(name);
+    return tag->name != NULL
+        && tag->name_length == length
+        && memcmp(tag->name, name, length) == 0;
+}
+
+nbt_status nbt_skip_payload(nbt_type type, const char** memory, size_t* length)
+{
+    assert(memory);
+    assert(length);
+
+    struct scanner s;
+    s.start     = (const unsigned char*)*memory;
+    s.p         = s.start;
+    s.end       = s.p + *length;
+    s.callbacks = NULL;
+    s.aux       = NULL;
+
+    int err = skip_payload(&s, type, 0);
+    if(err != NBT_OK) return (nbt_status)err;
+
+    *length -= (size_t)(s.p - (const unsigned char*)*memory);
+    *memory  = (const char*)s.p;
+    return NBT_OK;
+}
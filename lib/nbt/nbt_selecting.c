@@ -0,0 +1,342 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include "arena.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Matching a compound takes a bit per child of a step, see select_children. */
+#define MAX_STEP_CHILDREN 64
+
+/*
+ * The paths of a selector share their common beginnings, so they form a tree
+ * of steps. A step goes to the child of a compound called `name', or to every
+ * item of a list if `name' is NULL.
+ */
+struct step {
+    char* name;
+    int path; /* The path that ends at this step, -1 if none does. */
+
+    struct step** children;
+    size_t count;
+
+    /* For item steps: the paths going through here, which get a node per item. */
+    size_t* item_paths;
+    size_t item_path_count;
+};
+
+struct nbt_selector {
+    struct step root;
+    bool interned; /* Names belong to an arena, and are compared by pointer. */
+
+    size_t paths;
+    struct nbt_selection* results;
+    size_t* capacities;
+};
+
+static void free_steps(const struct nbt_selector* selector, struct step* step)
+{
+    for(size_t i = 0; i < step->count; i++)
+    {
+        struct step* child = step->children[i];
+        free_steps(selector, child);
+
+        if(!selector->interned) free(child->name);
+        free(child->item_paths);
+        free(child);
+    }
+
+    free(step->children);
+}
+
+void nbt_selector_free(struct nbt_selector* selector)
+{
+    if(selector == NULL) return;
+
+    free_steps(selector, &selector->root);
+
+    if(selector->results != NULL)
+        for(size_t i = 0; i < selector->paths; i++)
+            free(selector->results[i].nodes);
+
+    free(selector->results);
+    free(selector->capacities);
+    free(selector);
+}
+
+/*
+ * Returns the child of `parent' for the `length' bytes at `name', or for list
+ * items if `name' is NULL, adding it if it isn't there yet. Returns NULL and
+ * sets errno on failure.
+ */
+static struct step* step_child(struct nbt_selector* selector, struct nbt_arena* arena,
+                               struct step* parent, const char* name, size_t length)
+{
+    for(size_t i = 0; i < parent->count; i++)
+    {
+        struct step* child = parent->children[i];
+
+        if(name == NULL ? child->name == NULL
+                        : child->name != NULL && strncmp(child->name, name, length) == 0 && child->name[length] == '\0')
+            return child;
+    }
+
+    if(parent->count == MAX_STEP_CHILDREN)
+    {
+        errno = NBT_ERR;
+        return NULL;
+    }
+
+    struct step** children = realloc(parent->children, (parent->count + 1) * sizeof *children);
+    if(children == NULL) goto oom;
+    parent->children = children;
+
+    struct step* child = calloc(1, sizeof *child);
+    if(child == NULL) goto oom;
+    child->path = -1;
+
+    if(name != NULL)
+    {
+        if(selector->interned)
+            child->name = nbt_arena_intern_n(arena, name, length);
+        else if((child->name = malloc(length + 1)) != NULL)
+        {
+            memcpy(child->name, name, length);
+            child->name[length] = '\0';
+        }
+
+        if(child->name == NULL)
+        {
+            free(child);
+            goto oom;
+        }
+    }
+
+    parent->children[parent->count++] = child;
+    return child;
+
+oom:
+    errno = NBT_EMEM;
+    return NULL;
+}
+
+/* Adds the steps of `path', the `index'th one. Returns an nbt_status. */
+static int add_path(struct nbt_selector* selector, struct nbt_arena* arena, const char* path, size_t index)
+{
+    struct step* step = &selector->root;
+    struct step* items = NULL;
+
+    if(*path == '\0') return NBT_ERR;
+
+    for(;;)
+    {
+        const char* end = strchr(path, '.');
+        size_t length = end ? (size_t)(end - path) : strlen(path);
+
+        /* only one list per path, a node per item of nested lists wouldn't fit a selection */
+        if(length == 0 && items != NULL) return NBT_ERR;
+
+        step = step_child(selector, arena, step, length == 0 ? NULL : path, length);
+        if(step == NULL) return errno;
+
+        if(length == 0) items = step;
+
+        if(end == NULL) break;
+        path = end + 1;
+    }
+
+    if(step->path != -1) return NBT_ERR; /* the same path twice */
+    step->path = (int)index;
+
+    if(items != NULL)
+    {
+        size_t* item_paths = realloc(items->item_paths, (items->item_path_count + 1) * sizeof *item_paths);
+        if(item_paths == NULL) return NBT_EMEM;
+
+        item_paths[items->item_path_count++] = index;
+        items->item_paths = item_paths;
+    }
+
+    return NBT_OK;
+}
+
+struct nbt_selector* nbt_selector_new(struct nbt_arena* arena, const char* const* paths)
+{
+    assert(paths);
+
+    struct nbt_selector* selector = calloc(1, sizeof *selector);
+    if(selector == NULL)
+    {
+        errno = NBT_EMEM;
+        return NULL;
+    }
+
+    selector->root.path = -1;
+    selector->interned  = arena != NULL;
+
+    while(paths[selector->paths] != NULL) selector->paths++;
+
+    /* every selection has room for at least one node */
+    selector->results    = calloc(selector->paths, sizeof *selector->results);
+    selector->capacities = calloc(selector->paths, sizeof *selector->capacities);
+    if(selector->paths != 0 && (selector->results == NULL || selector->capacities == NULL))
+        goto oom;
+
+    for(size_t i = 0; i < selector->paths; i++)
+    {
+        if((selector->results[i].nodes = malloc(sizeof(nbt_node*))) == NULL) goto oom;
+        selector->capacities[i] = 1;
+
+        int err = add_path(selector, arena, paths[i], i);
+        if(err != NBT_OK)
+        {
+            errno = err;
+            nbt_selector_free(selector);
+            return NULL;
+        }
+    }
+
+    return selector;
+
+oom:
+    errno = NBT_EMEM;
+    nbt_selector_free(selector);
+    return NULL;
+}
+
+/* Makes room for a node per item in the selections of `step'. Returns an nbt_status. */
+static int size_item_paths(struct nbt_selector* selector, const struct step* step, size_t items)
+{
+    for(size_t i = 0; i < step->item_path_count; i++)
+    {
+        size_t path = step->item_paths[i];
+        struct nbt_selection* result = &selector->results[path];
+
+        if(selector->capacities[path] < items)
+        {
+            nbt_node** nodes = realloc(result->nodes, items * sizeof *nodes);
+            if(nodes == NULL) return NBT_EMEM;
+
+            result->nodes = nodes;
+            selector->capacities[path] = items;
+        }
+
+        memset(result->nodes, 0, items * sizeof *result->nodes);
+        result->count = items;
+    }
+
+    return NBT_OK;
+}
+
+static bool step_matches(const struct nbt_selector* selector, const struct step* step, const char* name)
+{
+    if(step->name == name) return true;
+    if(selector->interned || name == NULL) return false;
+
+    return step->name[0] == name[0] && strcmp(step->name, name) == 0;
+}
+
+static int select_node(struct nbt_selector* selector, const struct step* step, nbt_node* node, size_t item);
+
+/*
+ * Follows the steps below `step' into the children of `node'. The children of
+ * a compound are gone over once, for all steps at the same time, and the
+ * first child with a step's name is the one taken.
+ */
+static int select_children(struct nbt_selector* selector, const struct step* step, nbt_node* node, size_t item)
+{
+    int err;
+
+    if(node->type == TAG_COMPOUND)
+    {
+        uint64_t wanted = 0;
+        for(size_t i = 0; i < step->count; i++)
+            if(step->children[i]->name != NULL) wanted |= (uint64_t)1 << i;
+
+        nbt_node** pos;
+        nbt_list_for_each(pos, node->payload.tag_compound)
+        {
+            if(wanted == 0) break;
+
+            for(size_t i = 0; i < step->count; i++)
+            {
+                if(!(wanted >> i & 1) || !step_matches(selector, step->children[i], (*pos)->name)) continue;
+
+                wanted &= ~((uint64_t)1 << i);
+                if((err = select_node(selector, step->children[i], *pos, item)) != NBT_OK) return err;
+                break;
+            }
+        }
+    }
+    else if(node->type == TAG_LIST)
+    {
+        struct nbt_list* list = node->payload.tag_list;
+
+        for(size_t i = 0; i < step->count; i++)
+        {
+            const struct step* items = step->children[i];
+            if(items->name != NULL) continue;
+
+            if((err = size_item_paths(selector, items, list->length)) != NBT_OK) return err;
+
+            for(size_t k = 0; k < list->length; k++)
+                if((err = select_node(selector, items, list->items[k], k)) != NBT_OK) return err;
+        }
+    }
+
+    return NBT_OK;
+}
+
+static int select_node(struct nbt_selector* selector, const struct step* step, nbt_node* node, size_t item)
+{
+    if(step->path != -1)
+        selector->results[step->path].nodes[item] = node;
+
+    if(step->count == 0) return NBT_OK;
+    return select_children(selector, step, node, item);
+}
+
+static void clear_item_paths(struct nbt_selector* selector, const struct step* step)
+{
+    for(size_t i = 0; i < step->item_path_count; i++)
+        selector->results[step->item_paths[i]].count = 0;
+
+    for(size_t i = 0; i < step->count; i++)
+        clear_item_paths(selector, step->children[i]);
+}
+
+const struct nbt_selection* nbt_select(struct nbt_selector* selector, nbt_node* tree)
+{
+    assert(selector);
+    assert(tree);
+
+    for(size_t i = 0; i < selector->paths; i++)
+    {
+        selector->results[i].nodes[0] = NULL;
+        selector->results[i].count    = 1;
+    }
+
+    /* paths through a list have no nodes until the list is found */
+    clear_item_paths(selector, &selector->root);
+
+    int err = select_children(selector, &selector->root, tree, 0);
+    if(err != NBT_OK)
+    {
+        errno = err;
+        return NULL;
+    }
+
+    return selector->results;
+}
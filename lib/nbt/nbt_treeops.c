@@ -37,17 +37,11 @@ void nbt_free_list(struct nbt_list* list)
     if (!list)
         return;
 
-    struct list_head* current;
-    struct list_head* temp;
-    list_for_each_safe(current, temp, &list->entry)
-    {
-        struct nbt_list* entry = list_entry(current, struct nbt_list, entry);
-
-        nbt_free(entry->data);
-        free(entry);
-    }
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
+        nbt_free(*pos);
 
-    free(list->data);
+    free(list->items);
     free(list);
 }
 
@@ -77,41 +71,43 @@ void nbt_free(nbt_node* tree)
     free(tree);
 }
 
-static struct nbt_list* clone_list(struct nbt_list* list)
+/*
+ * Allocates an empty list with room for `capacity' children, of the same type
+ * as `list'. `items' is never NULL, not even for empty lists.
+ */
+static struct nbt_list* new_list_like(const struct nbt_list* list, size_t capacity)
 {
-    /* even empty lists are valid pointers! */
-    assert(list);
-
     struct nbt_list* ret;
-    CHECKED_MALLOC(ret, sizeof *ret, goto clone_error);
 
-    INIT_LIST_HEAD(&ret->entry);
+    if(capacity == 0) capacity = 1;
 
-    ret->data = NULL;
+    CHECKED_MALLOC(ret, sizeof *ret, return NULL);
+    CHECKED_MALLOC(ret->items, capacity * sizeof *ret->items, free(ret); return NULL);
 
-    if(list->data != NULL)
-    {
-        CHECKED_MALLOC(ret->data, sizeof *ret->data, goto clone_error);
-        ret->data->type = list->data->type;
-    }
+    ret->length   = 0;
+    ret->capacity = capacity;
+    ret->type     = list->type;
 
-    struct list_head* pos;
-    list_for_each(pos, &list->entry)
-    {
-        struct nbt_list* current = list_entry(pos, struct nbt_list, entry);
-        struct nbt_list* new;
+    return ret;
+}
+
+static struct nbt_list* clone_list(struct nbt_list* list)
+{
+    /* even empty lists are valid pointers! */
+    assert(list);
 
-        CHECKED_MALLOC(new, sizeof *new, goto clone_error);
+    struct nbt_list* ret = new_list_like(list, list->length);
+    if(ret == NULL) goto clone_error;
 
-        new->data = nbt_clone(current->data);
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
+    {
+        nbt_node* new = nbt_clone(*pos);
 
-        if(new->data == NULL)
-        {
-            free(new);
+        if(new == NULL)
             goto clone_error;
-        }
 
-        list_add_tail(&new->entry, &ret->entry);
+        ret->items[ret->length++] = new;
     }
 
     return ret;
@@ -164,12 +160,13 @@ nbt_node* nbt_clone(nbt_node* tree)
         int32_t* newbuf;
         CHECKED_MALLOC(newbuf, tree->payload.tag_int_array.length * sizeof(int32_t), goto clone_error);
 
-        memcpy(newbuf,
-               tree->payload.tag_int_array.data,
-               tree->payload.tag_int_array.length);
+        /* clones are always native, even of borrowed arrays */
+        for(int32_t i = 0; i < tree->payload.tag_int_array.length; i++)
+            newbuf[i] = nbt_int_array_get(&tree->payload.tag_int_array, i);
 
-        ret->payload.tag_int_array.data   = newbuf;
-        ret->payload.tag_int_array.length = tree->payload.tag_int_array.length;
+        ret->payload.tag_int_array.data       = newbuf;
+        ret->payload.tag_int_array.length     = tree->payload.tag_int_array.length;
+        ret->payload.tag_int_array.big_endian = false;
     }
 
     else if(tree->type == TAG_LONG_ARRAY)
@@ -177,12 +174,13 @@ nbt_node* nbt_clone(nbt_node* tree)
         int64_t* newbuf;
         CHECKED_MALLOC(newbuf, tree->payload.tag_long_array.length * sizeof(int64_t), goto clone_error);
 
-        memcpy(newbuf,
-               tree->payload.tag_long_array.data,
-               tree->payload.tag_long_array.length);
+        /* clones are always native, even of borrowed arrays */
+        for(int32_t i = 0; i < tree->payload.tag_long_array.length; i++)
+            newbuf[i] = nbt_long_array_get(&tree->payload.tag_long_array, i);
 
-        ret->payload.tag_long_array.data   = newbuf;
-        ret->payload.tag_long_array.length = tree->payload.tag_long_array.length;
+        ret->payload.tag_long_array.data       = newbuf;
+        ret->payload.tag_long_array.length     = tree->payload.tag_long_array.length;
+        ret->payload.tag_long_array.big_endian = false;
     }
 
     else if(tree->type == TAG_LIST)
@@ -209,33 +207,103 @@ clone_error:
     return NULL;
 }
 
-bool nbt_map(nbt_node* tree, nbt_visitor_t v, void* aux)
+/* Deeper trees than this make nbt_walk move its stack to the heap. */
+#define WALK_INLINE_DEPTH 32
+
+/* The children of a list or compound still to be walked. */
+struct walk_frame {
+    nbt_node** pos;
+    nbt_node** end;
+};
+
+nbt_status nbt_walk(nbt_node* tree, nbt_walker_t walker, void* aux)
 {
-    assert(v);
+    assert(walker);
 
-    if(tree == NULL)  return true;
-    if(!v(tree, aux)) return false;
+    struct walk_frame inline_stack[WALK_INLINE_DEPTH];
+    struct walk_frame* stack = inline_stack;
+    size_t capacity = WALK_INLINE_DEPTH;
+    size_t depth = 0;
 
-    /* And if the item is a list or compound, recurse through each of their elements. */
-    if(tree->type == TAG_COMPOUND)
-    {
-        struct list_head* pos;
+    nbt_status ret = NBT_OK;
+    nbt_node* node = tree;
 
-        list_for_each(pos, &tree->payload.tag_compound->entry)
-            if(!nbt_map(list_entry(pos, struct nbt_list, entry)->data, v, aux))
-                return false;
-    }
-    
-    if(tree->type == TAG_LIST)
+    while(node != NULL)
     {
-        struct list_head* pos;
+        nbt_visit_action action = walker(node, aux);
+        if(action == NBT_VISIT_STOP) break;
+
+        if(action == NBT_VISIT_CONTINUE && (node->type == TAG_LIST || node->type == TAG_COMPOUND))
+        {
+            struct nbt_list* list = node->type == TAG_LIST ? node->payload.tag_list : node->payload.tag_compound;
+
+            if(depth == capacity)
+            {
+                struct walk_frame* grown = malloc(capacity * 2 * sizeof *grown);
+                if(grown == NULL)
+                {
+                    ret = NBT_EMEM;
+                    break;
+                }
+
+                memcpy(grown, stack, depth * sizeof *stack);
+                if(stack != inline_stack) free(stack);
+
+                stack = grown;
+                capacity *= 2;
+            }
+
+            stack[depth].pos = list->items;
+            stack[depth].end = list->items + list->length;
+            depth++;
+        }
 
-        list_for_each(pos, &tree->payload.tag_list->entry)
-            if(!nbt_map(list_entry(pos, struct nbt_list, entry)->data, v, aux))
-                return false;
+        /* on to the next child, going back up past the lists that are done */
+        node = NULL;
+        while(depth > 0)
+        {
+            struct walk_frame* top = &stack[depth - 1];
+
+            if(top->pos != top->end)
+            {
+                node = *top->pos++;
+                break;
+            }
+
+            depth--;
+        }
     }
 
-    return true;
+    if(stack != inline_stack) free(stack);
+
+    if(ret != NBT_OK) errno = ret;
+    return ret;
+}
+
+struct map_walk {
+    nbt_visitor_t visitor;
+    void* aux;
+    bool stopped;
+};
+
+static nbt_visit_action map_walker(nbt_node* node, void* aux)
+{
+    struct map_walk* map = aux;
+
+    if(map->visitor(node, map->aux)) return NBT_VISIT_CONTINUE;
+
+    map->stopped = true;
+    return NBT_VISIT_STOP;
+}
+
+bool nbt_map(nbt_node* tree, nbt_visitor_t v, void* aux)
+{
+    assert(v);
+
+    struct map_walk map = { .visitor = v, .aux = aux, .stopped = false };
+
+    if(nbt_walk(tree, map_walker, &map) != NBT_OK) return false;
+    return !map.stopped;
 }
 
 /* Only returns NULL on error. An empty list is still a valid pointer */
@@ -243,27 +311,18 @@ static struct nbt_list* filter_list(const struct nbt_list* list, nbt_predicate_t
 {
     assert(list);
 
-    struct nbt_list* ret = NULL;
-    CHECKED_MALLOC(ret, sizeof *ret, goto filter_error);
+    struct nbt_list* ret = new_list_like(list, list->length);
+    if(ret == NULL) goto filter_error;
 
-    ret->data = NULL;
-    INIT_LIST_HEAD(&ret->entry);
-
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
     {
-        const struct nbt_list* p = list_entry(pos, struct nbt_list, entry);
-
-        nbt_node* new_node = nbt_filter(p->data, predicate, aux);
+        nbt_node* new_node = nbt_filter(*pos, predicate, aux);
 
         if(errno != NBT_OK)  goto filter_error;
         if(new_node == NULL) continue;
 
-        struct nbt_list* new_entry;
-        CHECKED_MALLOC(new_entry, sizeof *new_entry, goto filter_error);
-
-        new_entry->data = new_node;
-        list_add_tail(&new_entry->entry, &ret->entry);
+        ret->items[ret->length++] = new_node;
     }
 
     return ret;
@@ -318,11 +377,11 @@ nbt_node* nbt_filter(const nbt_node* tree, nbt_predicate_t filter, void* aux)
                        tree->payload.tag_int_array.length * sizeof(int32_t),
                        goto filter_error);
 
-        memcpy(ret->payload.tag_int_array.data,
-               tree->payload.tag_int_array.data,
-               tree->payload.tag_int_array.length);
+        for(int32_t i = 0; i < tree->payload.tag_int_array.length; i++)
+            ret->payload.tag_int_array.data[i] = nbt_int_array_get(&tree->payload.tag_int_array, i);
 
-        ret->payload.tag_int_array.length = tree->payload.tag_int_array.length;
+        ret->payload.tag_int_array.length     = tree->payload.tag_int_array.length;
+        ret->payload.tag_int_array.big_endian = false;
     }
 
     else if(tree->type == TAG_LONG_ARRAY)
@@ -331,11 +390,11 @@ nbt_node* nbt_filter(const nbt_node* tree, nbt_predicate_t filter, void* aux)
                        tree->payload.tag_long_array.length * sizeof(int64_t),
                        goto filter_error);
 
-        memcpy(ret->payload.tag_long_array.data,
-               tree->payload.tag_long_array.data,
-               tree->payload.tag_long_array.length);
+        for(int32_t i = 0; i < tree->payload.tag_long_array.length; i++)
+            ret->payload.tag_long_array.data[i] = nbt_long_array_get(&tree->payload.tag_long_array, i);
 
-        ret->payload.tag_long_array.length = tree->payload.tag_long_array.length;
+        ret->payload.tag_long_array.length     = tree->payload.tag_long_array.length;
+        ret->payload.tag_long_array.big_endian = false;
     }
 
     /* Okay, we want to keep this node, but keep traversing the tree! */
@@ -375,46 +434,44 @@ nbt_node* nbt_filter_inplace(nbt_node* tree, nbt_predicate_t filter, void* aux)
     if(tree->type != TAG_LIST &&
        tree->type != TAG_COMPOUND) return tree;
 
-    struct list_head* pos;
-    struct list_head* n;
     struct nbt_list* list = tree->type == TAG_LIST ? tree->payload.tag_list : tree->payload.tag_compound;
 
-    list_for_each_safe(pos, n, &list->entry)
+    /* compact the survivors to the front, keeping their order */
+    size_t kept = 0;
+    for(size_t i = 0; i < list->length; i++)
     {
-        struct nbt_list* cur = list_entry(pos, struct nbt_list, entry);
+        nbt_node* cur = nbt_filter_inplace(list->items[i], filter, aux);
 
-        cur->data = nbt_filter_inplace(cur->data, filter, aux);
-
-        if(cur->data == NULL)
-        {
-            list_del(pos);
-            free(cur);
-        }
+        if(cur != NULL)
+            list->items[kept++] = cur;
     }
+    list->length = kept;
 
     return tree;
 }
 
-nbt_node* nbt_find(nbt_node* tree, nbt_predicate_t predicate, void* aux)
+struct find_walk {
+    nbt_predicate_t predicate;
+    void* aux;
+    nbt_node* found;
+};
+
+static nbt_visit_action find_walker(nbt_node* node, void* aux)
 {
-    if(tree == NULL)                  return NULL;
-    if(predicate(tree, aux))          return tree;
-    if(tree->type != TAG_LIST &&
-       tree->type != TAG_COMPOUND)    return NULL;
+    struct find_walk* find = aux;
 
-    struct list_head* pos;
-    struct nbt_list* list = tree->type == TAG_LIST ? tree->payload.tag_list : tree->payload.tag_compound;
-    
-    list_for_each(pos, &list->entry)
-    {
-        struct nbt_list* p = list_entry(pos, struct nbt_list, entry);
-        struct nbt_node* found;
+    if(!find->predicate(node, find->aux)) return NBT_VISIT_CONTINUE;
 
-        if((found = nbt_find(p->data, predicate, aux)))
-            return found;
-    }
+    find->found = node;
+    return NBT_VISIT_STOP;
+}
 
-    return NULL;
+nbt_node* nbt_find(nbt_node* tree, nbt_predicate_t predicate, void* aux)
+{
+    struct find_walk find = { .predicate = predicate, .aux = aux, .found = NULL };
+
+    nbt_walk(tree, find_walker, &find);
+    return find.found;
 }
 
 static bool names_are_equal(const nbt_node* node, void* vname)
@@ -423,7 +480,8 @@ static bool names_are_equal(const nbt_node* node, void* vname)
 
     assert(node);
 
-    if(name == NULL && node->name == NULL)
+    /* also true for interned names, and when both are NULL */
+    if(node->name == name)
         return true;
 
     if(name == NULL || node->name == NULL)
@@ -437,6 +495,45 @@ nbt_node* nbt_find_by_name(nbt_node* tree, const char* name)
     return nbt_find(tree, &names_are_equal, (void*)name);
 }
 
+/*
+ * Compounds in the wild hold a handful to a few dozen tags, so a straight
+ * scan of the children beats building an index for them.
+ */
+nbt_node* nbt_compound_get(nbt_node* compound, const char* name)
+{
+    assert(name);
+
+    if(compound == NULL || compound->type != TAG_COMPOUND)
+        return NULL;
+
+    nbt_node** pos;
+    nbt_list_for_each(pos, compound->payload.tag_compound)
+    {
+        nbt_node* child = *pos;
+
+        if(child->name == name ||
+           (child->name != NULL && child->name[0] == name[0] && strcmp(child->name, name) == 0))
+            return child;
+    }
+
+    return NULL;
+}
+
+nbt_node* nbt_compound_get_interned(nbt_node* compound, const char* name)
+{
+    assert(name);
+
+    if(compound == NULL || compound->type != TAG_COMPOUND)
+        return NULL;
+
+    nbt_node** pos;
+    nbt_list_for_each(pos, compound->payload.tag_compound)
+        if((*pos)->name == name)
+            return *pos;
+
+    return NULL;
+}
+
 /*
  * Returns the index of the first occurence of `c' in `s', or the index of the
  * NULL-terminator. Whichever comes first.
@@ -501,14 +598,13 @@ nbt_node* nbt_find_by_path(nbt_node* tree, const char* path)
 
     /* At this point, the inital names match, and we're not at a leaf node. */
 
-    struct list_head* pos;
+    nbt_node** pos;
     struct nbt_list* list = tree->type == TAG_LIST ? tree->payload.tag_list : tree->payload.tag_compound;
-    list_for_each(pos, &list->entry)
+    nbt_list_for_each(pos, list)
     {
-        struct nbt_list* elem = list_entry(pos, struct nbt_list, entry);
         nbt_node* r;
 
-        if((r = nbt_find_by_path(elem->data, path + e + 1)) != NULL)
+        if((r = nbt_find_by_path(*pos, path + e + 1)) != NULL)
             return r;
     }
 
@@ -521,9 +617,9 @@ static inline size_t nbt_full_list_length(struct nbt_list* list)
 {
     size_t accum = 0;
 
-    struct list_head* pos;
-    list_for_each(pos, &list->entry)
-        accum += nbt_size(list_entry(pos, const struct nbt_list, entry)->data);
+    nbt_node** pos;
+    nbt_list_for_each(pos, list)
+        accum += nbt_size(*pos);
 
     return accum;
 }
@@ -544,14 +640,9 @@ size_t nbt_size(const nbt_node* tree)
 nbt_node* nbt_list_item(nbt_node* list, int n) {
     if (list == NULL || (list->type != TAG_LIST && list->type != TAG_COMPOUND))
         return NULL;
-    
-    int i = 0;
-    const struct list_head* pos;
 
-    list_for_each(pos, &list->payload.tag_list->entry) {
-        if (i++ == n)
-            return list_entry(pos, struct nbt_list, entry)->data;
-    }
+    if (n < 0 || (size_t)n >= list->payload.tag_list->length)
+        return NULL;
 
-    return NULL;
+    return list->payload.tag_list->items[n];
 }
@@ -9,8 +9,37 @@
  */
 #include "nbt.h"
 
+#include <assert.h>
 #include <string.h>
 
+int32_t nbt_int_array_get(const struct nbt_int_array* array, int32_t i)
+{
+    assert(array);
+    assert(i >= 0 && i < array->length);
+
+    if(!array->big_endian)
+        return array->data[i];
+
+    const unsigned char* p = (const unsigned char*)array->data + (size_t)i * sizeof(int32_t);
+    return (int32_t)((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+}
+
+int64_t nbt_long_array_get(const struct nbt_long_array* array, int32_t i)
+{
+    assert(array);
+    assert(i >= 0 && i < array->length);
+
+    if(!array->big_endian)
+        return array->data[i];
+
+    const unsigned char* p = (const unsigned char*)array->data + (size_t)i * sizeof(int64_t);
+    uint64_t v = 0;
+    for(size_t k = 0; k < sizeof(int64_t); k++)
+        v = v << 8 | p[k];
+
+    return (int64_t)v;
+}
+
 const char* nbt_type_to_string(nbt_type t)
 {
 #define DEF_CASE(name) case name: return #name;
@@ -109,37 +138,30 @@ bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b)
                       a->payload.tag_byte_array.length) == 0;
     case TAG_INT_ARRAY:
         if(a->payload.tag_int_array.length != b->payload.tag_int_array.length) return false;
-        return memcmp(a->payload.tag_int_array.data,
-                      b->payload.tag_int_array.data,
-                      a->payload.tag_int_array.length) == 0;
+        for(int32_t i = 0; i < a->payload.tag_int_array.length; i++)
+            if(nbt_int_array_get(&a->payload.tag_int_array, i) != nbt_int_array_get(&b->payload.tag_int_array, i))
+                return false;
+        return true;
     case TAG_LONG_ARRAY:
         if(a->payload.tag_long_array.length != b->payload.tag_long_array.length) return false;
-        return memcmp(a->payload.tag_long_array.data,
-                      b->payload.tag_long_array.data,
-                      a->payload.tag_long_array.length) == 0;
+        for(int32_t i = 0; i < a->payload.tag_long_array.length; i++)
+            if(nbt_long_array_get(&a->payload.tag_long_array, i) != nbt_long_array_get(&b->payload.tag_long_array, i))
+                return false;
+        return true;
     case TAG_STRING:
         return strcmp(a->payload.tag_string, b->payload.tag_string) == 0;
     case TAG_LIST:
     case TAG_COMPOUND:
     {
-        struct list_head *ai, *bi;
         struct nbt_list* alist = a->type == TAG_LIST ? a->payload.tag_list : a->payload.tag_compound;
         struct nbt_list* blist = b->type == TAG_LIST ? b->payload.tag_list : b->payload.tag_compound;
 
-        for(ai = alist->entry.flink, bi = blist->entry.flink;
-            ai != &alist->entry &&   bi != &blist->entry;
-            ai = ai->flink,          bi = bi->flink)
-        {
-            struct nbt_list* ae = list_entry(ai, struct nbt_list, entry);
-            struct nbt_list* be = list_entry(bi, struct nbt_list, entry);
+        if(alist->length != blist->length)
+            return false;
 
-            if(!nbt_eq(ae->data, be->data))
+        for(size_t i = 0; i < alist->length; i++)
+            if(!nbt_eq(alist->items[i], blist->items[i]))
                 return false;
-        }
-
-        /* if there are still elements left in either list... */
-        if(ai != &alist->entry || bi != &blist->entry)
-            return false;
 
         return true;
     }
@@ -0,0 +1,30 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef NBT_SCANNING_H
+#define NBT_SCANNING_H
+
+#include "nbt.h"
+
+#include <stddef.h>
+
+/*
+ * Minecraft refuses anything nested deeper than this, so we do too. It keeps
+ * a malicious file from running us out of stack.
+ */
+#define NBT_SCAN_MAX_DEPTH 512
+
+/*
+ * Moves `memory' past a payload of type `type' without looking at it, and
+ * takes what was skipped off `length'. Returns NBT_ERR if the payload does not
+ * fit in `length' bytes, in which case neither is touched.
+ */
+nbt_status nbt_skip_payload(nbt_type type, const char** memory, size_t* length);
+
+#endif
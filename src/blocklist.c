@@ -0,0 +1,88 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include "blocklist.h"
+
+
+bool read_block_list(const char *path, bool listed[256])
+{
+  FILE *f = fopen(path, "r");
+  if(f == NULL)
+  {
+    fprintf(stderr, "Could not open block list '%s'. (%s)\n", path, strerror(errno));
+    return false;
+  }
+
+  char word[32];
+  size_t length = 0;
+  bool in_comment = false;
+  unsigned long line = 1;
+  for(;;)
+  {
+    int c = fgetc(f);
+
+    if(c != EOF && !isspace(c) && c != '#' && !in_comment)
+    {
+      if(length == sizeof(word) - 1)
+      {
+        fprintf(stderr, "Invalid block id on line %lu of '%s'.\n", line, path);
+        fclose(f);
+        return false;
+      }
+      word[length++] = (char) c;
+      continue;
+    }
+
+    if(length != 0)
+    {
+      word[length] = '\0';
+      length = 0;
+
+      char *end;
+      errno = 0;
+      unsigned long id = strtoul(word, &end, 10);
+      if(errno != 0 || *end != '\0' || word[0] == '-' || word[0] == '+' || id > UINT8_MAX)
+      {
+        fprintf(stderr, "Invalid block id '%s' on line %lu of '%s'.\n", word, line, path);
+        fclose(f);
+        return false;
+      }
+      listed[id] = true;
+    }
+
+    if(c == EOF) break;
+    if(c == '#') in_comment = true;
+    if(c == '\n')
+    {
+      in_comment = false;
+      line++;
+    }
+  }
+
+  bool ok = !ferror(f);
+  if(!ok) fprintf(stderr, "Could not read block list '%s'.\n", path);
+  fclose(f);
+  return ok;
+}
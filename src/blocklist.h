@@ -0,0 +1,31 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NIN_ANVIL_BLOCKLIST_H
+#define NIN_ANVIL_BLOCKLIST_H
+
+#include <stdbool.h>
+
+/*
+ * Reads a list of block ids from 'path' into 'listed', which must be zeroed.
+ * Ids are separated by whitespace, and everything from a '#' to the end of the line is a comment.
+ * Returns false after printing an error if the file could not be read or holds anything but ids from 0 to 255.
+ */
+bool read_block_list(const char *path, bool listed[256]);
+
+#endif
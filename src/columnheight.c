@@ -0,0 +1,182 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "columnheight.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+void ground_bitset_init(struct ground_bitset *bitset, const struct ground_blocks *ground)
+{
+  memset(bitset, 0, sizeof(*bitset));
+  for(unsigned int id = 0; id < 256; id++)
+  {
+    if(!ground->is_ground[id]) continue;
+
+    uint8_t *bytes = id < 128 ? bitset->low : bitset->high;
+    bytes[id & 15] |= (uint8_t) (1u << ((id >> 4) & 7));
+  }
+}
+
+static bool raise_columns_scalar(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground)
+{
+  unsigned int missing = 0;
+  for(unsigned int j = 0; j < 256; j++)
+    if(!found[j]) missing++;
+
+  for(int y = 15; y >= 0 && missing != 0; y--)
+  {
+    uint8_t current_y = (uint8_t) (base_y + y);
+    for(unsigned int j = 0; j < 256; j++)
+    {
+      if(!ground->is_ground[blocks[y * 256 + j]]) continue;
+
+      if(current_y > heightmap[j]) heightmap[j] = current_y;
+      if(!found[j])
+      {
+        found[j] = 0xff;
+        missing--;
+      }
+    }
+  }
+  return missing == 0;
+}
+
+#ifdef HAVE_X86_SIMD
+
+// The bit that each high nibble of a block id has in its bitset byte.
+#define NIBBLE_BITS 1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128
+
+// 0xff for every block id in 'ids' that is ground, 0 for the others.
+__attribute__((target("sse4.1")))
+static inline __m128i ground_mask_sse41(__m128i ids, __m128i low, __m128i high, __m128i nibble_bits)
+{
+  __m128i low_nibbles = _mm_and_si128(ids, _mm_set1_epi8(15));
+  __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(ids, 4), _mm_set1_epi8(15));
+
+  // blendv picks by the top bit of each id, which is what tells the two halves apart
+  __m128i bytes = _mm_blendv_epi8(_mm_shuffle_epi8(low, low_nibbles), _mm_shuffle_epi8(high, low_nibbles), ids);
+  __m128i bits = _mm_shuffle_epi8(nibble_bits, high_nibbles);
+  return _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits);
+}
+
+__attribute__((target("sse4.1")))
+static bool raise_columns_sse41(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_bitset *bitset)
+{
+  __m128i low = _mm_loadu_si128((const __m128i *) bitset->low);
+  __m128i high = _mm_loadu_si128((const __m128i *) bitset->high);
+  __m128i nibble_bits = _mm_setr_epi8(NIBBLE_BITS);
+
+  bool all_found = false;
+  for(int y = 15; y >= 0 && !all_found; y--)
+  {
+    __m128i current_y = _mm_set1_epi8((char) (base_y + y));
+    __m128i all = _mm_set1_epi8(-1);
+    for(unsigned int j = 0; j < 256; j += 16)
+    {
+      __m128i ids = _mm_loadu_si128((const __m128i *) (blocks + y * 256 + j));
+      __m128i ground = ground_mask_sse41(ids, low, high, nibble_bits);
+
+      __m128i heights = _mm_loadu_si128((const __m128i *) (heightmap + j));
+      __m128i columns = _mm_or_si128(_mm_loadu_si128((const __m128i *) (found + j)), ground);
+      _mm_storeu_si128((__m128i *) (heightmap + j), _mm_max_epu8(heights, _mm_and_si128(ground, current_y)));
+      _mm_storeu_si128((__m128i *) (found + j), columns);
+      all = _mm_and_si128(all, columns);
+    }
+    all_found = _mm_movemask_epi8(all) == 0xffff;
+  }
+  return all_found;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i ground_mask_avx2(__m256i ids, __m256i low, __m256i high, __m256i nibble_bits)
+{
+  __m256i low_nibbles = _mm256_and_si256(ids, _mm256_set1_epi8(15));
+  __m256i high_nibbles = _mm256_and_si256(_mm256_srli_epi16(ids, 4), _mm256_set1_epi8(15));
+
+  __m256i bytes = _mm256_blendv_epi8(_mm256_shuffle_epi8(low, low_nibbles), _mm256_shuffle_epi8(high, low_nibbles), ids);
+  __m256i bits = _mm256_shuffle_epi8(nibble_bits, high_nibbles);
+  return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+}
+
+__attribute__((target("avx2")))
+static bool raise_columns_avx2(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_bitset *bitset)
+{
+  // shuffles stay within 128 bit lanes, so both lanes get the whole table
+  __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) bitset->low));
+  __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) bitset->high));
+  __m256i nibble_bits = _mm256_setr_epi8(NIBBLE_BITS, NIBBLE_BITS);
+
+  // The whole heightmap fits in registers, only the blocks are read layer by layer.
+  __m256i heights[8];
+  __m256i columns[8];
+  for(unsigned int k = 0; k < 8; k++)
+  {
+    heights[k] = _mm256_loadu_si256((const __m256i *) (heightmap + k * 32));
+    columns[k] = _mm256_loadu_si256((const __m256i *) (found + k * 32));
+  }
+
+  bool all_found = false;
+  for(int y = 15; y >= 0 && !all_found; y--)
+  {
+    __m256i current_y = _mm256_set1_epi8((char) (base_y + y));
+    __m256i all = _mm256_set1_epi8(-1);
+    for(unsigned int k = 0; k < 8; k++)
+    {
+      __m256i ids = _mm256_loadu_si256((const __m256i *) (blocks + y * 256 + k * 32));
+      __m256i ground = ground_mask_avx2(ids, low, high, nibble_bits);
+
+      heights[k] = _mm256_max_epu8(heights[k], _mm256_and_si256(ground, current_y));
+      columns[k] = _mm256_or_si256(columns[k], ground);
+      all = _mm256_and_si256(all, columns[k]);
+    }
+    all_found = _mm256_movemask_epi8(all) == -1;
+  }
+
+  for(unsigned int k = 0; k < 8; k++)
+  {
+    _mm256_storeu_si256((__m256i *) (heightmap + k * 32), heights[k]);
+    _mm256_storeu_si256((__m256i *) (found + k * 32), columns[k]);
+  }
+  return all_found;
+}
+
+#endif
+
+bool raise_columns(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset)
+{
+#ifdef HAVE_X86_SIMD
+  if(__builtin_cpu_supports("avx2")) return raise_columns_avx2(heightmap, found, blocks, base_y, bitset);
+  if(__builtin_cpu_supports("sse4.1")) return raise_columns_sse41(heightmap, found, blocks, base_y, bitset);
+#else
+  (void) bitset;
+#endif
+
+  return raise_columns_scalar(heightmap, found, blocks, base_y, ground);
+}
@@ -0,0 +1,60 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NIN_ANVIL_COLUMNHEIGHT_H
+#define NIN_ANVIL_COLUMNHEIGHT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Whether a block type should be ignored or not when calculating block column height, indexed by block id.
+ * This is useful for example when you want to exclude leaves and logs (trees) from the resulting DEM.
+ */
+struct ground_blocks
+{
+  bool is_ground[256];
+};
+
+/*
+ * The ground blocks as a bitset, laid out so that a byte shuffle looks up 16 or 32 block ids at once.
+ * A block id's low nibble picks a byte, from 'low' for ids below 128 and from 'high' for the others,
+ * and its high nibble picks the bit in that byte.
+ */
+struct ground_bitset
+{
+  uint8_t low[16];
+  uint8_t high[16];
+};
+
+void ground_bitset_init(struct ground_bitset *bitset, const struct ground_blocks *ground);
+
+/*
+ * Raises every column of 'heightmap' to the y of the highest ground block in 'blocks',
+ * 16 layers of 256 block ids from the bottom up, the lowest of which is at 'base_y'.
+ * 'found' is 0xff for every column that has hit ground, and is updated along with 'heightmap'.
+ * The layers are gone over from the top down, and the section is left as soon as every column has hit ground,
+ * so sections must be given from the top down as well.
+ * Returns true once every column has hit ground, lower sections can't change the heightmap then.
+ * On x86 this uses AVX2 or SSE4.1 when the CPU has them.
+ */
+bool raise_columns(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset);
+
+#endif
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include <xtiffio.h>
 #include <geotiffio.h>
@@ -29,6 +30,9 @@
 #include "utils.h"
 #include "maketif.h"
 #include "parsingutils.h"
+#include "threadpool.h"
+#include "world.h"
+#include "blocklist.h"
 #include "constants.h"
 #include "conversions.h"
 
@@ -80,20 +84,67 @@ West(-x)    +----+----+----+----+----+----+----+----+----+----+----+----+----+--
  * Row and column are always relative to their container.
  */
 
-static uint8_t forbidden_blocks[] = {0, 18, 161, 17, 162, 8, 9};
-static const size_t forbidden_blocks_size = sizeof(forbidden_blocks);
+// Ignored when neither --blocks nor --ignoredblocks is given: air, leaves, logs and water.
+static const uint8_t default_ignored_blocks[] = {0, 18, 161, 17, 162, 8, 9};
+
+// Blocks up to Minecraft 1.12 that don't block light at all, so the stored HeightMap passes through them.
+// Every other block counts for it, including leaves, water, ice and cobwebs, which only dim light.
+static const uint8_t transparent_blocks[] = {
+  0, 6, 10, 11, 20, 26, 27, 28, 31, 32, 34, 36, 37, 38, 39, 40, 50, 51, 52, 54, 55, 59, 63, 64, 65, 66, 68, 69,
+  70, 71, 72, 75, 76, 77, 78, 81, 83, 85, 90, 92, 93, 94, 95, 96, 101, 102, 104, 105, 106, 107, 111, 113, 115,
+  116, 117, 118, 119, 120, 122, 127, 130, 131, 132, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148, 149,
+  150, 151, 154, 157, 160, 165, 166, 167, 171, 175, 176, 177, 178, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+  192, 193, 194, 195, 196, 197, 198, 199, 200, 207, 209, 217, 219, 220, 221, 222, 223, 224, 225, 226, 227, 228,
+  229, 230, 231, 232, 233, 234
+};
 
 /*
- * Whether a block type should be ignored or not when calculating block column height
- * This is useful for example when you want to exclude leaves and logs (trees) from the resulting DEM.
+ * Works out which blocks count as ground.
+ * With --blocks only the listed blocks do, otherwise all blocks do.
+ * Then the blocks of --ignoredblocks, or the default ones if neither option was given, are taken out again.
+ * With --heightmap, the blocks that block light are ground, so that chunks without a usable stored heightmap
+ * get the same heights as the others. Block lists that say otherwise are rejected.
  */
-static bool is_ground(uint8_t block_id)
+static void ground_blocks_init(struct ground_blocks *ground, const char *blocks_path, const char *ignored_blocks_path,
+    bool use_height_map)
 {
-  for (size_t i = 0; i < forbidden_blocks_size; i++)
+  struct ground_blocks light_blocking;
+  memset(light_blocking.is_ground, 1, sizeof(light_blocking.is_ground));
+  for(size_t i = 0; i < sizeof(transparent_blocks); i++) light_blocking.is_ground[transparent_blocks[i]] = false;
+
+  if(use_height_map && blocks_path == NULL && ignored_blocks_path == NULL)
+  {
+    *ground = light_blocking;
+    return;
+  }
+
+  if(blocks_path != NULL)
   {
-    if(forbidden_blocks[i] == block_id) return false;
+    memset(ground->is_ground, 0, sizeof(ground->is_ground));
+    if(!read_block_list(blocks_path, ground->is_ground)) exit(EXIT_FAILURE);
+  }
+  else
+  {
+    memset(ground->is_ground, 1, sizeof(ground->is_ground));
+  }
+
+  bool ignored[256] = {false};
+  if(ignored_blocks_path != NULL)
+  {
+    if(!read_block_list(ignored_blocks_path, ignored)) exit(EXIT_FAILURE);
+  }
+  else if(blocks_path == NULL)
+    for(size_t i = 0; i < sizeof(default_ignored_blocks); i++) ignored[default_ignored_blocks[i]] = true;
+
+  for(size_t i = 0; i < 256; i++)
+    if(ignored[i]) ground->is_ground[i] = false;
+
+  if(use_height_map && memcmp(ground->is_ground, light_blocking.is_ground, sizeof(ground->is_ground)) != 0)
+  {
+    fprintf(stderr, "--heightmap can not be used with --blocks or --ignoredblocks, "
+        "unless they make exactly the blocks that block light ground.\n");
+    exit(EXIT_FAILURE);
   }
-  return true;
 }
 
 // returns -1 if none matched
@@ -130,16 +181,190 @@ static int compression_from_string(const char *str)
 }
 
 
+// returns 0 if str is not a valid amount of jobs
+static unsigned int jobs_from_string(const char *str)
+{
+  char *end;
+  errno = 0;
+  unsigned long jobs = strtoul(str, &end, 10);
+  if(errno != 0 || end == str || *end != '\0' || jobs > UINT_MAX || str[0] == '-') return 0;
+  return (unsigned int) jobs;
+}
+
+// Creates one parse context per worker, each parsing chunks on 'chunk_threads' threads.
+static struct parse_ctx *parse_ctxs_new(unsigned int count, const struct ground_blocks *ground, bool use_height_map,
+    unsigned int chunk_threads, enum chunk_parser parser)
+{
+  struct parse_ctx *ctxs = malloc(sizeof(*ctxs) * count);
+  if(ctxs == NULL)
+  {
+    fprintf(stderr, "Could not allocate parse contexts. (%s)", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  for(unsigned int i = 0; i < count; i++) parse_ctx_init(&ctxs[i], ground, use_height_map, chunk_threads, parser);
+  return ctxs;
+}
+
+static void parse_ctxs_free(struct parse_ctx *ctxs, unsigned int count)
+{
+  for(unsigned int i = 0; i < count; i++) parse_ctx_destroy(&ctxs[i]);
+  free(ctxs);
+}
+
+struct batch
+{
+  const char **files;
+  uint8_t *imgbufs;
+  struct parse_ctx *ctxs;
+  enum region_reader reader;
+  int compression;
+};
+
+static void convert_region(size_t index, unsigned int worker, void *aux)
+{
+  struct batch *batch = aux;
+  uint8_t *imgbuf = batch->imgbufs + (size_t) worker * REGION_SIZE;
+  memset(imgbuf, 0, REGION_SIZE);
+
+  long long region_x;
+  long long region_y;
+  if(!regionfile2dem(imgbuf, batch->files[index], batch->reader, &batch->ctxs[worker], &region_x, &region_y)) return;
+  printf("main.c: cartesian region coords x: %lli, y: %lli\n", region_x, region_y);
+
+  struct lli_xy origin = region_origin_topleft(region_x, region_y);
+  struct lli_bounds bounds = region_bounds(region_x, region_y);
+
+  char *output_filename;
+  if(asprintf(&output_filename, "%llix_%lliy.tif", region_x, region_y) == -1)
+  {
+    fprintf(stderr, "Could not generate output file name.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  maketif(output_filename, imgbuf, batch->compression,
+      origin.x,
+      origin.y,
+      REGION_WIDTH,
+      REGION_HEIGHT,
+      bounds.maxx,
+      bounds.minx,
+      bounds.maxy,
+      bounds.miny);
+
+  free(output_filename);
+}
+
+struct world_batch
+{
+  struct world *world;
+  struct mosaic *mosaic;
+  struct parse_ctx *ctxs;
+  enum region_reader reader;
+};
+
+static void convert_world_region(size_t index, unsigned int worker, void *aux)
+{
+  struct world_batch *batch = aux;
+  regionfile2mosaic(batch->mosaic, batch->world->regions[index].path, batch->reader, &batch->ctxs[worker]);
+}
+
+/*
+ * Converts all regions of a world into a single GeoTIFF.
+ */
+static void convert_world(const char *world_path, enum dimension dimension, const char *output_filename,
+    const struct ground_blocks *ground, bool use_height_map, enum region_reader reader, enum chunk_parser parser,
+    int compression, unsigned int jobs)
+{
+  char *region_dir = world_region_dir(world_path, dimension);
+  struct world world;
+  world_scan(&world, region_dir);
+  if(world.region_count == 0)
+  {
+    fprintf(stderr, "Could not find any region files in '%s'.\n", region_dir);
+    exit(EXIT_FAILURE);
+  }
+  free(region_dir);
+
+  // Minecraft's z axis points south, so the north-most region (min z) has the max cartesian region y.
+  struct lli_bounds topleft = region_bounds(world.min_x, -world.min_z - 1);
+  struct lli_bounds bottomright = region_bounds(world.max_x, -world.max_z - 1);
+  struct lli_xy origin = region_origin_topleft(world.min_x, -world.min_z - 1);
+
+  struct mosaic mosaic = {
+    .origin_x = origin.x,
+    .origin_y = origin.y,
+    .width = (size_t) (world.max_x - world.min_x + 1) * REGION_WIDTH,
+    .height = (size_t) (world.max_z - world.min_z + 1) * REGION_HEIGHT,
+  };
+
+  // calloc() hands out lazily zeroed pages, so areas without regions don't take up memory until written out.
+  mosaic.outbuf = calloc(mosaic.width, mosaic.height);
+  if(mosaic.outbuf == NULL)
+  {
+    fprintf(stderr, "Could not allocate image buffer. (%s)", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  unsigned int region_jobs = jobs > world.region_count ? world.region_count : jobs;
+  struct world_batch batch = {
+    .world = &world,
+    .mosaic = &mosaic,
+    .ctxs = parse_ctxs_new(region_jobs, ground, use_height_map, jobs / region_jobs, parser),
+    .reader = reader,
+  };
+  parallel_for(world.region_count, region_jobs, convert_world_region, &batch);
+  parse_ctxs_free(batch.ctxs, region_jobs);
+
+  maketif(output_filename, mosaic.outbuf, compression,
+      mosaic.origin_x,
+      mosaic.origin_y,
+      mosaic.width,
+      mosaic.height,
+      bottomright.maxx,
+      topleft.minx,
+      topleft.maxy,
+      bottomright.miny);
+
+  free(mosaic.outbuf);
+  world_free(&world);
+}
+
+
 void print_usage(const char *prog_str)
 {
   printf(
-    "Usage: %s [options] region_file\n"
+    "Usage: %s [options] region_file...\n"
+    "       %s [options] --world=<directory>\n"
     "Options:\n"
     "  -h, --help                Show this usage information.\n"
     "  -v, --version             Show version information.\n"
     "  --blocks=<file>           List of blocks that should be taken into account.\n"
     "  --ignoredblocks=<file>    List of blocks that should NOT be taken into account.\n"
+    "  --heightmap               Use the heightmaps stored in chunks where possible, see below.\n"
     "  --compression=<scheme>    TIFF compression scheme, defaults to DEFLATE.\n"
+    "  --reader=<reader>         How region files are read, defaults to mmap.\n"
+    "  --parser=<parser>         How chunk NBT is read, defaults to scan.\n"
+    "  -j N, --jobs=N            Use N threads, defaults to 1.\n"
+    "  --world=<directory>       Convert a whole world into a single GeoTIFF.\n"
+    "  --dimension=<dimension>   Dimension of the world to convert, defaults to overworld.\n"
+    "  --output=<file>           Output file for --world, defaults to world.tif.\n"
+    "\n"
+    "dimension can be one of the following values:\n"
+    "overworld, nether, end\n"
+    "\n"
+    "reader can be one of the following values:\n"
+    "mmap   Map the whole file into memory, best when files are in the page cache.\n"
+    "pread  Only read the sectors of existing chunks, best on slow or network storage.\n"
+    "\n"
+    "parser can be one of the following values:\n"
+    "scan   Only read the tags needed for the DEM, straight from the decompressed chunk.\n"
+    "tree   Build an NBT tree of the tags needed for the DEM first.\n"
+    "tape   Index all tags of a chunk in one pass first, then read the needed ones from the index.\n"
+    "\n"
+    "With --heightmap, the height of a column is that of its highest block that blocks light,\n"
+    "as stored in the chunk, which includes leaves and water. Chunks without a usable stored\n"
+    "heightmap are read with the same rule. It can't be combined with --blocks or --ignoredblocks,\n"
+    "unless they make exactly the blocks that block light count.\n"
     "\n"
     "scheme is case-insensitive and can be one of the following values:\n"
     "NONE, "
@@ -166,7 +391,7 @@ void print_usage(const char *prog_str)
     "SGILOG, "
     "SGILOG24, "
     "JP2000\n"
-    ,prog_str
+    ,prog_str, prog_str
   );
 }
 
@@ -194,9 +419,19 @@ int main(int argc, char *argv[])
   const char *files[argc - 1];
   size_t files_i = 0;
   size_t opts_i = 0;
+  const char *jobs_string = NULL;
   for(int i = 1; i < argc; i++)
   {
-    if(string_starts_with(argv[i], "-"))
+    if(streq(argv[i], "-j"))
+    {
+      if(i + 1 >= argc)
+      {
+        fprintf(stderr, "Option '-j' requires an argument.\n");
+        exit(EXIT_FAILURE);
+      }
+      jobs_string = argv[++i];
+    }
+    else if(string_starts_with(argv[i], "-"))
       opts[opts_i++] = argv[i];
     else
       files[files_i++] = argv[i];
@@ -205,6 +440,14 @@ int main(int argc, char *argv[])
   size_t optscount = opts_i;
 
   int compression = COMPRESSION_DEFLATE;
+  enum region_reader reader = REGION_READER_MMAP;
+  enum chunk_parser parser = CHUNK_PARSER_SCAN;
+  const char *world_path = NULL;
+  enum dimension dimension = DIMENSION_OVERWORLD;
+  const char *output_filename = "world.tif";
+  const char *blocks_path = NULL;
+  const char *ignored_blocks_path = NULL;
+  bool use_height_map = false;
   // Print requested information and continue
   for(size_t i = 0; i < optscount; i++) {
     if(streq(opts[i], "--version") || streq(opts[i], "-v"))
@@ -221,45 +464,114 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
       }
     }
+    else if(string_starts_with(opts[i], "--jobs="))
+      jobs_string = opts[i] + strlen("--jobs=");
+    else if(string_starts_with(opts[i], "-j"))
+      jobs_string = opts[i] + strlen("-j");
+    else if(string_starts_with(opts[i], "--world="))
+      world_path = opts[i] + strlen("--world=");
+    else if(string_starts_with(opts[i], "--output="))
+      output_filename = opts[i] + strlen("--output=");
+    else if(string_starts_with(opts[i], "--blocks="))
+      blocks_path = opts[i] + strlen("--blocks=");
+    else if(string_starts_with(opts[i], "--ignoredblocks="))
+      ignored_blocks_path = opts[i] + strlen("--ignoredblocks=");
+    else if(streq(opts[i], "--heightmap"))
+      use_height_map = true;
+    else if(string_starts_with(opts[i], "--dimension="))
+    {
+      const char *dimension_string = opts[i] + strlen("--dimension=");
+      if(streq(dimension_string, "overworld"))
+        dimension = DIMENSION_OVERWORLD;
+      else if(streq(dimension_string, "nether"))
+        dimension = DIMENSION_NETHER;
+      else if(streq(dimension_string, "end"))
+        dimension = DIMENSION_END;
+      else
+      {
+        fprintf(stderr, "Specified invalid dimension '%s'\n", dimension_string);
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if(string_starts_with(opts[i], "--reader="))
+    {
+      const char *reader_string = opts[i] + strlen("--reader=");
+      if(streq(reader_string, "mmap"))
+        reader = REGION_READER_MMAP;
+      else if(streq(reader_string, "pread"))
+        reader = REGION_READER_PREAD;
+      else
+      {
+        fprintf(stderr, "Specified invalid reader '%s'\n", reader_string);
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if(string_starts_with(opts[i], "--parser="))
+    {
+      const char *parser_string = opts[i] + strlen("--parser=");
+      if(streq(parser_string, "scan"))
+        parser = CHUNK_PARSER_SCAN;
+      else if(streq(parser_string, "tree"))
+        parser = CHUNK_PARSER_TREE;
+      else if(streq(parser_string, "tape"))
+        parser = CHUNK_PARSER_TAPE;
+      else
+      {
+        fprintf(stderr, "Specified invalid parser '%s'\n", parser_string);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  unsigned int jobs = 1;
+  if(jobs_string != NULL)
+  {
+    jobs = jobs_from_string(jobs_string);
+    if(jobs == 0)
+    {
+      fprintf(stderr, "Specified invalid amount of jobs '%s'\n", jobs_string);
+      exit(EXIT_FAILURE);
+    }
   }
-  if(filecount == 0) exit(EXIT_SUCCESS);
 
+  struct ground_blocks ground;
+  ground_blocks_init(&ground, blocks_path, ignored_blocks_path, use_height_map);
 
-  const size_t imgbuf_size = REGION_SIZE;
-  uint8_t *imgbuf = calloc(imgbuf_size, 1);
-  if(imgbuf == NULL)
+  if(world_path != NULL)
   {
-    fprintf(stderr, "Could not allocate image buffer. (%s)", strerror(errno));
-    exit(EXIT_FAILURE);
+    if(filecount != 0)
+    {
+      fprintf(stderr, "Region files can not be specified together with --world.\n");
+      exit(EXIT_FAILURE);
+    }
+    convert_world(world_path, dimension, output_filename, &ground, use_height_map, reader, parser, compression, jobs);
+    return EXIT_SUCCESS;
   }
 
-  long long region_x;
-  long long region_y;
-  regionfile2dem(imgbuf, files[0], is_ground, &region_x, &region_y);
-  printf("main.c: cartesian region coords x: %lli, y: %lli\n", region_x, region_y);
+  if(filecount == 0) exit(EXIT_SUCCESS);
 
-  struct lli_xy origin = region_origin_topleft(region_x, region_y);
-  struct lli_bounds bounds = region_bounds(region_x, region_y);
+  // Regions are spread over the jobs first. When there are more jobs than regions,
+  // the remaining threads are used to parse the chunks of each region in parallel.
+  unsigned int region_jobs = jobs > filecount ? filecount : jobs;
 
-  char *output_filename;
-  if(asprintf(&output_filename, "%llix_%lliy.tif", region_x, region_y) == -1)
+  // Every worker reuses a single image buffer for all regions it converts.
+  const size_t imgbuf_size = REGION_SIZE;
+  uint8_t *imgbufs = malloc(imgbuf_size * region_jobs);
+  if(imgbufs == NULL)
   {
-    fprintf(stderr, "Could not generate output file name.\n");
+    fprintf(stderr, "Could not allocate image buffer. (%s)", strerror(errno));
     exit(EXIT_FAILURE);
   }
 
-  maketif(output_filename, imgbuf, compression,
-      origin.x,
-      origin.y,
-      REGION_WIDTH,
-      REGION_HEIGHT,
-      bounds.maxx,
-      bounds.minx,
-      bounds.maxy,
-      bounds.miny);
+  struct batch batch = {
+    .files = files,
+    .imgbufs = imgbufs,
+    .ctxs = parse_ctxs_new(region_jobs, &ground, use_height_map, jobs / region_jobs, parser),
+    .reader = reader,
+    .compression = compression,
+  };
+  parallel_for(filecount, region_jobs, convert_region, &batch);
+  parse_ctxs_free(batch.ctxs, region_jobs);
 
-  free(output_filename);
-  free(imgbuf); // TODO use atexit() instead to free up resources
+  free(imgbufs); // TODO use atexit() instead to free up resources
   return EXIT_SUCCESS;
 }
-
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stddef.h> // for size_t
+#include <pthread.h>
 #include <xtiffio.h>
 #include <geotiffio.h>
 
@@ -34,6 +35,11 @@ static const TIFFFieldInfo tiff_field_info[] = {
 };
 
 
+// XTIFFOpen() lazily installs a global tag extender the first time it is called,
+// which is not thread-safe, so opening files is serialized.
+static pthread_mutex_t open_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 static void register_custom_tiff_tags(TIFF *tif) {
   TIFFMergeFieldInfo(tif, tiff_field_info, sizeof(tiff_field_info) / sizeof(tiff_field_info[0]));
 }
@@ -83,7 +89,22 @@ void maketif(
     min_cartesian_y
   );
 
-  TIFF *tif = XTIFFOpen(filepath, "w");
+  // These all start at 1, not 0
+  // Note that TIFF rows start at 0 instead of 1
+  const size_t minrow = buf_origin_cartesian_y - max_cartesian_y + 1;
+  const size_t maxrow = buf_origin_cartesian_y - min_cartesian_y + 1;
+  const size_t maxcol = max_cartesian_x - buf_origin_cartesian_x + 1;
+  const size_t mincol = min_cartesian_x - buf_origin_cartesian_x + 1;
+
+  const size_t width = maxcol - mincol + 1;
+  const size_t height = maxrow - minrow + 1;
+
+  // Classic TIFF files can not exceed 4 GiB, so large mosaics are written as BigTIFF.
+  const char *mode = (unsigned long long) width * height >= 0xF0000000ull ? "w8" : "w";
+
+  pthread_mutex_lock(&open_mutex);
+  TIFF *tif = XTIFFOpen(filepath, mode);
+  pthread_mutex_unlock(&open_mutex);
   if(tif == NULL)
   {
     fprintf(stderr, "Could not open %s for writing.", filepath);
@@ -97,16 +118,6 @@ void maketif(
     exit(EXIT_FAILURE);
   }
 
-  // These all start at 1, not 0
-  // Note that TIFF rows start at 0 instead of 1
-  const size_t minrow = buf_origin_cartesian_y - max_cartesian_y + 1;
-  const size_t maxrow = buf_origin_cartesian_y - min_cartesian_y + 1;
-  const size_t maxcol = max_cartesian_x - buf_origin_cartesian_x + 1;
-  const size_t mincol = min_cartesian_x - buf_origin_cartesian_x + 1;
-
-  const size_t width = maxcol - mincol + 1;
-  const size_t height = maxrow - minrow + 1;
-
   // TODO checked integer casts to uint32 from TIFF
   TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
   TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <arpa/inet.h>
 
@@ -29,6 +30,9 @@
 
 #include "utils.h"
 #include "parseregion.h"
+#include "regionfile.h"
+#include "threadpool.h"
+#include "world.h"
 
 
 #define htonll(x) ((1==htonl(1)) ? (x) : ((uint64_t)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
@@ -49,234 +53,985 @@ struct chunkpos {
 };
 
 
-static bool handle_section(nbt_node *section, void *aux);
-static void handle_chunk(nbt_node *chunk,
-    long long *max_cartesian_x,
-    long long *min_cartesian_x,
-    long long *max_cartesian_y,
-    long long *min_cartesian_y,
+static bool handle_section(struct chunk_ctx *cctx, nbt_node *section, nbt_node *section_y_nbt, nbt_node *blocks);
+static bool handle_chunk(struct chunk_ctx *cctx,
+    nbt_node *chunk,
+    bool with_sections,
+    bool *done,
     output_point_func_t output_point,
     void *output_point_aux);
+static bool tree_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux);
+static bool scan_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux);
+static bool tape_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux);
+
+// The only tags parsed for handle_chunk. Entities, tile entities, ticks and light are never parsed.
+static const char *const chunk_paths[] = {
+  "Level.xPos",
+  "Level.zPos",
+  "Level.Sections..Y",
+  "Level.Sections..Blocks",
+  NULL
+};
+
+// Parsed first with a stored heightmap, the sections are only parsed if it can't be used.
+static const char *const height_map_paths[] = {
+  "Level.xPos",
+  "Level.zPos",
+  "Level.HeightMap",
+  NULL
+};
+
+// The tags handle_chunk looks up in a chunk, in the order its selector returns them.
+enum chunk_field
+{
+  CHUNK_FIELD_LEVEL,
+  CHUNK_FIELD_X_POS,
+  CHUNK_FIELD_Z_POS,
+  CHUNK_FIELD_HEIGHT_MAP,
+  CHUNK_FIELD_SECTIONS,
+  CHUNK_FIELD_SECTION,
+  CHUNK_FIELD_SECTION_Y,
+  CHUNK_FIELD_SECTION_BLOCKS,
+  CHUNK_FIELD_COUNT
+};
+
+// Their paths, indexed by enum chunk_field.
+static const char *const chunk_fields[] = {
+  [CHUNK_FIELD_LEVEL] = "Level",
+  [CHUNK_FIELD_X_POS] = "Level.xPos",
+  [CHUNK_FIELD_Z_POS] = "Level.zPos",
+  [CHUNK_FIELD_HEIGHT_MAP] = "Level.HeightMap",
+  [CHUNK_FIELD_SECTIONS] = "Level.Sections",
+  [CHUNK_FIELD_SECTION] = "Level.Sections.",
+  [CHUNK_FIELD_SECTION_Y] = "Level.Sections..Y",
+  [CHUNK_FIELD_SECTION_BLOCKS] = "Level.Sections..Blocks",
+  [CHUNK_FIELD_COUNT] = NULL
+};
+
+static void discard_sections(struct chunk_ctx *cctx);
+
+static void clear_columns(struct chunk_ctx *cctx)
+{
+  memset(cctx->heightmap, 0, sizeof(cctx->heightmap));
+  memset(cctx->columns_found, 0, sizeof(cctx->columns_found));
+}
+
+static void chunk_ctx_reset_bounds(struct chunk_ctx *cctx)
+{
+  cctx->max_cartesian_x = LLONG_MIN;
+  cctx->min_cartesian_x = LLONG_MAX;
+  cctx->max_cartesian_y = LLONG_MIN;
+  cctx->min_cartesian_y = LLONG_MAX;
+}
+
+void parse_ctx_init(struct parse_ctx *ctx, const struct ground_blocks *ground, bool use_height_map,
+    unsigned int threads, enum chunk_parser parser)
+{
+  assert(ctx != NULL);
+  assert(ground != NULL);
+
+  if(threads == 0) threads = 1;
+
+  ctx->parser = parser;
+  ctx->use_height_map = use_height_map;
+  ctx->threads = threads;
+  ctx->chunk_ctxs = malloc(sizeof(*ctx->chunk_ctxs) * threads);
+  if(ctx->chunk_ctxs == NULL)
+  {
+    fprintf(stderr, "Could not allocate chunk contexts. (%s)\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  for(unsigned int i = 0; i < threads; i++)
+  {
+    struct chunk_ctx *cctx = &ctx->chunk_ctxs[i];
+    cctx->ground = *ground;
+    ground_bitset_init(&cctx->ground_bitset, ground);
+    cctx->use_height_map = use_height_map;
+    cctx->decompressor = nbt_decompressor_new();
+    if(cctx->decompressor == NULL)
+    {
+      fprintf(stderr, "Could not create decompressor. (%s)\n", nbt_error_to_string(errno));
+      exit(EXIT_FAILURE);
+    }
+    cctx->arena = nbt_arena_new();
+    if(cctx->arena == NULL)
+    {
+      fprintf(stderr, "Could not create NBT arena. (%s)\n", nbt_error_to_string(errno));
+      exit(EXIT_FAILURE);
+    }
+    cctx->tape = nbt_tape_new();
+    if(cctx->tape == NULL)
+    {
+      fprintf(stderr, "Could not create NBT tape. (%s)\n", nbt_error_to_string(errno));
+      exit(EXIT_FAILURE);
+    }
+    cctx->selector = nbt_selector_new(cctx->arena, chunk_fields);
+    if(cctx->selector == NULL)
+    {
+      fprintf(stderr, "Could not compile chunk tag selector. (%s)\n", nbt_error_to_string(errno));
+      exit(EXIT_FAILURE);
+    }
+    memset(cctx->section_blocks, 0, sizeof(cctx->section_blocks));
+    cctx->top_section_y = -1;
+    clear_columns(cctx);
+    chunk_ctx_reset_bounds(cctx);
+  }
+}
+
+void parse_ctx_destroy(struct parse_ctx *ctx)
+{
+  assert(ctx != NULL);
+
+  for(unsigned int i = 0; i < ctx->threads; i++)
+  {
+    nbt_decompressor_free(ctx->chunk_ctxs[i].decompressor);
+    nbt_selector_free(ctx->chunk_ctxs[i].selector);
+    nbt_tape_free(ctx->chunk_ctxs[i].tape);
+    nbt_arena_free(ctx->chunk_ctxs[i].arena);
+  }
+  free(ctx->chunk_ctxs);
+  ctx->chunk_ctxs = NULL;
+  ctx->threads = 0;
+}
+
+struct region_job
+{
+  struct parse_ctx *ctx;
+  const uint8_t *buf;
+  size_t size;
+  const struct chunk_location *locations;
+  const char *filepath;
+  int dir_length; // length of the directory part of filepath, -1 if it has none
+  bool has_region_coords;
+  long long region_x;
+  long long region_z;
+  output_point_func_t output_point_func;
+  void *output_point_aux;
+};
 
-static is_ground_func_t is_ground_func;
+// Reads the external chunk file of the chunk in 'slot', returns NULL after warning if it couldn't.
+// The returned buffer must be freed by the caller.
+static uint8_t *read_external_chunk(const struct region_job *job, uint16_t slot, size_t *out_length)
+{
+  if(!job->has_region_coords)
+  {
+    fprintf(stderr, "Warning: chunk %" PRIu16 " of '%s' is stored externally, but the region coordinates are unknown. Skipping chunk.\n",
+        slot, job->filepath != NULL ? job->filepath : "region");
+    return NULL;
+  }
+
+  long long chunk_x = job->region_x * 32 + slot % 32;
+  long long chunk_z = job->region_z * 32 + slot / 32;
+
+  char path[PATH_MAX];
+  int written;
+  if(job->dir_length >= 0)
+    written = snprintf(path, sizeof(path), "%.*s/c.%lld.%lld.mcc", job->dir_length, job->filepath, chunk_x, chunk_z);
+  else
+    written = snprintf(path, sizeof(path), "c.%lld.%lld.mcc", chunk_x, chunk_z);
+  if(written < 0 || (size_t) written >= sizeof(path))
+  {
+    fprintf(stderr, "Warning: path of external chunk %lld, %lld is too long. Skipping chunk.\n", chunk_x, chunk_z);
+    return NULL;
+  }
+
+  FILE *fp = fopen(path, "rb");
+  if(fp == NULL)
+  {
+    fprintf(stderr, "Warning: could not open external chunk file '%s'. (%s) Skipping chunk.\n", path, strerror(errno));
+    return NULL;
+  }
+
+  uint8_t *data = NULL;
+  size_t length = 0;
+  long file_size;
+  if(fseek(fp, 0, SEEK_END) != 0 || (file_size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+  {
+    fprintf(stderr, "Warning: could not read external chunk file '%s'. (%s) Skipping chunk.\n", path, strerror(errno));
+    fclose(fp);
+    return NULL;
+  }
+  length = (size_t) file_size;
+  data = malloc(length > 0 ? length : 1);
+  if(data == NULL)
+  {
+    fprintf(stderr, "Could not allocate memory for external chunk file '%s'. (%s)\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if(fread(data, 1, length, fp) != length)
+  {
+    fprintf(stderr, "Warning: could not read external chunk file '%s'. Skipping chunk.\n", path);
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+
+  *out_length = length;
+  return data;
+}
+
+// Parses the chunk at index 'index' of the region's location list.
+// A chunk that can't be read is skipped with a warning, so one bad chunk doesn't abort a whole world.
+static void parse_chunk_location(size_t index, unsigned int worker, void *aux)
+{
+  struct region_job *job = aux;
+  struct chunk_ctx *cctx = &job->ctx->chunk_ctxs[worker];
+  const struct chunk_location *location = &job->locations[index];
+  const uint8_t *buf = job->buf;
+  const size_t size = job->size;
+  const char *name = job->filepath != NULL ? job->filepath : "region";
+
+  size_t offset = (size_t) location->sector_offset * REGION_SECTOR_SIZE;
+
+  // The chunk header is 5 bytes long, the length includes the compression scheme byte.
+  if(offset >= size || size - offset < 5)
+  {
+    fprintf(stderr, "Warning: chunk %" PRIu16 " of '%s' lies outside of the file. Skipping chunk.\n", location->slot, name);
+    return;
+  }
+  const uint8_t *chunk_pointer = buf + offset;
+  uint32_t chunk_length = 0;
+  memcpy(&chunk_length, chunk_pointer, 4);
+  chunk_length = ntoh32(chunk_length);
+  if(chunk_length == 0 || chunk_length - 1 > size - offset - 5)
+  {
+    fprintf(stderr, "Warning: chunk %" PRIu16 " of '%s' has an invalid length. Skipping chunk.\n", location->slot, name);
+    return;
+  }
+  uint8_t compression_scheme = chunk_pointer[4];
+  const uint8_t *payload = chunk_pointer + 5;
+  size_t payload_length = chunk_length - 1;
+
+  // Chunks too large for the region file are stored in a c.<x>.<z>.mcc file next to it,
+  // the region file then only holds the header with the high bit of the scheme set.
+  uint8_t *external = NULL;
+  if(compression_scheme & 0x80)
+  {
+    compression_scheme &= 0x7f;
+    external = read_external_chunk(job, location->slot, &payload_length);
+    if(external == NULL) return;
+    payload = external;
+  }
+
+  const void *nbt = NULL;
+  size_t nbt_length = 0;
+  switch(compression_scheme)
+  {
+    case 1: // gzip
+    case 2: // zlib
+      nbt = nbt_decompress(cctx->decompressor, payload, payload_length, &nbt_length);
+      break;
+
+    case 3: // uncompressed
+      nbt = payload;
+      nbt_length = payload_length;
+      break;
+
+    case 4: // LZ4
+      nbt = nbt_decompress_lz4(cctx->decompressor, payload, payload_length, &nbt_length);
+      break;
+
+    default:
+      fprintf(stderr, "Warning: chunk %" PRIu16 " of '%s' uses unsupported compression scheme %" PRIu8 ". Skipping chunk.\n",
+          location->slot, name, compression_scheme);
+      free(external);
+      return;
+  }
+
+  if(nbt == NULL)
+  {
+    fprintf(stderr, "Warning: could not decompress chunk %" PRIu16 " of '%s'. (%s) Skipping chunk.\n",
+        location->slot, name, nbt_error_to_string(errno));
+    free(external);
+    return;
+  }
+
+  bool parsed;
+  cctx->error = NULL;
+  cctx->slot = location->slot;
+  cctx->has_region_coords = job->has_region_coords;
+  cctx->region_x = job->region_x;
+  cctx->region_z = job->region_z;
+  if(job->ctx->parser == CHUNK_PARSER_SCAN)
+    parsed = scan_chunk(cctx, nbt, nbt_length, job->output_point_func, job->output_point_aux);
+  else if(job->ctx->parser == CHUNK_PARSER_TAPE)
+    parsed = tape_chunk(cctx, nbt, nbt_length, job->output_point_func, job->output_point_aux);
+  else
+    parsed = tree_chunk(cctx, nbt, nbt_length, job->output_point_func, job->output_point_aux);
+
+  if(!parsed)
+  {
+    fprintf(stderr, "Warning: could not read chunk %" PRIu16 " of '%s'. (%s) Skipping chunk.\n",
+        location->slot, name, cctx->error != NULL ? cctx->error : nbt_error_to_string(errno));
+
+    // Sections that were already added, or a stored heightmap, must not leak into the next chunk.
+    discard_sections(cctx);
+    clear_columns(cctx);
+  }
+  free(external);
+}
 
 // buf size should be at least 4096.
 // 'size' is the amount of available bytes in buf, thus it should be at least 4096.
-void parse_region(const uint8_t *buf, const size_t size,
+void parse_region(struct parse_ctx *ctx,
+    const uint8_t *buf, const size_t size,
+    const char *filepath,
     long long *out_max_cartesian_x,
     long long *out_min_cartesian_x,
     long long *out_max_cartesian_y,
     long long *out_min_cartesian_y,
     output_point_func_t output_point_func,
-    void *output_point_aux,
-    is_ground_func_t loc_is_ground_func)
+    void *output_point_aux)
 {
+  assert(ctx != NULL);
   assert(size >= 4096);
   assert(out_max_cartesian_x != NULL);
   assert(out_min_cartesian_x != NULL);
   assert(out_max_cartesian_y != NULL);
   assert(out_min_cartesian_y != NULL);
   assert(output_point_func != NULL);
-  assert(loc_is_ground_func != NULL);
 
-  is_ground_func = loc_is_ground_func;
-  for(size_t i = 0; i < 4096; i += 4)
-  {
-    uint32_t offset = 0;
-    ((unsigned char *) &offset)[1] = buf[i];
-    ((unsigned char *) &offset)[2] = buf[i + 1];
-    ((unsigned char *) &offset)[3] = buf[i + 2];
-    offset = ntoh32(offset);
-    offset *= 4096;
-
-    uint8_t chunk_size = 0;
-    chunk_size = buf[i + 3];
+  for(unsigned int i = 0; i < ctx->threads; i++) chunk_ctx_reset_bounds(&ctx->chunk_ctxs[i]);
 
-    if(offset == 0 && chunk_size == 0) continue; // Chunk hasn't been generated yet.
+  // Sectors are allocated in the order chunks were written, so the location table order jumps around the file.
+  // Visiting chunks in sector order instead keeps reads monotonic, which lets the kernel's readahead do its job.
+  struct chunk_location locations[REGION_CHUNK_COUNT];
+  size_t location_count = region_chunk_locations(buf, locations);
 
-    if(offset >= size)
+  // Every chunk is compressed on its own and covers its own 16x16 blocks of output,
+  // so chunks can be handed out to threads independently.
+  struct region_job job = {
+    .ctx = ctx,
+    .buf = buf,
+    .size = size,
+    .locations = locations,
+    .filepath = filepath,
+    .dir_length = -1,
+    .has_region_coords = false,
+    .output_point_func = output_point_func,
+    .output_point_aux = output_point_aux,
+  };
+  if(filepath != NULL)
+  {
+    const char *filename = strrchr(filepath, '/');
+    if(filename != NULL)
     {
-      fprintf(stderr, "Corrupt file.\n");
-      exit(EXIT_FAILURE);
+      job.dir_length = (int) (filename - filepath);
+      filename++;
     }
-    const uint8_t *chunk_pointer = buf + offset;
-    uint32_t chunk_length = 0;
-    memcpy(&chunk_length, chunk_pointer, 4);
-    chunk_length = ntoh32(chunk_length);
-    uint8_t compression_scheme = 0;
-    memcpy(&compression_scheme, chunk_pointer + 4, 1);
-    if(compression_scheme != 2)
+    else
     {
-      fprintf(stderr, "Unsupported chunk compression scheme. (%" PRIu8 ")\n", compression_scheme);
-      exit(EXIT_FAILURE);
+      filename = filepath;
     }
+    job.has_region_coords = region_filename_coords(filename, &job.region_x, &job.region_z);
+  }
+  parallel_for(location_count, ctx->threads, parse_chunk_location, &job);
 
-    nbt_node *chunk = nbt_parse_compressed(chunk_pointer + 5, chunk_length);
-    if(chunk == NULL)
-    {
-      fprintf(stderr, "Could not parse chunk NBT. (%s)\n", nbt_error_to_string(errno));
-      exit(EXIT_FAILURE);
-    }
-    handle_chunk(chunk,
-      out_max_cartesian_x,
-      out_min_cartesian_x,
-      out_max_cartesian_y,
-      out_min_cartesian_y,
-      output_point_func,
-      output_point_aux);
-    nbt_free(chunk);
+  for(unsigned int i = 0; i < ctx->threads; i++)
+  {
+    struct chunk_ctx *cctx = &ctx->chunk_ctxs[i];
+    if(cctx->max_cartesian_x > *out_max_cartesian_x) *out_max_cartesian_x = cctx->max_cartesian_x;
+    if(cctx->min_cartesian_x < *out_min_cartesian_x) *out_min_cartesian_x = cctx->min_cartesian_x;
+    if(cctx->max_cartesian_y > *out_max_cartesian_y) *out_max_cartesian_y = cctx->max_cartesian_y;
+    if(cctx->min_cartesian_y < *out_min_cartesian_y) *out_min_cartesian_y = cctx->min_cartesian_y;
   }
 }
 
-// Variables used in handle_chunk and handle_section
-static uint8_t current_chunk_heightmap[256];
-static int8_t last_section_y = -1;
+// Marks the current chunk as unusable for 'reason', a constant string. Always returns false.
+static bool chunk_error(struct chunk_ctx *cctx, const char *reason)
+{
+  cctx->error = reason;
+  return false;
+}
+
+// Whether a section with this Y should be added, the first one of every Y at or above 0 is.
+static bool wants_section(const struct chunk_ctx *cctx, int section_y)
+{
+  return section_y >= 0 && section_y < 128 && cctx->section_blocks[section_y] == NULL;
+}
+
+// Remembers the blocks of a section, the heightmap is worked out from them by reduce_sections().
+static void add_section(struct chunk_ctx *cctx, int8_t section_y, const uint8_t *blocks)
+{
+  assert(wants_section(cctx, section_y));
+
+  cctx->section_blocks[section_y] = blocks;
+  if(section_y > cctx->top_section_y) cctx->top_section_y = section_y;
+}
+
+/*
+ * Raises the heightmap to the highest ground block of every column, going over the sections from the top down.
+ * Usually the top one or two sections have ground in every column, the ones below are never looked at then.
+ * The added sections are forgotten afterwards.
+ */
+static void reduce_sections(struct chunk_ctx *cctx)
+{
+  bool all_found = false;
+  for(int y = cctx->top_section_y; y >= 0; y--)
+  {
+    const uint8_t *blocks = cctx->section_blocks[y];
+    if(blocks == NULL) continue;
+    cctx->section_blocks[y] = NULL;
+
+    if(!all_found)
+      all_found = raise_columns(cctx->heightmap, cctx->columns_found, blocks, (uint8_t) (y * 16),
+          &cctx->ground, &cctx->ground_bitset);
+  }
+  cctx->top_section_y = -1;
+}
 
-static void handle_chunk(nbt_node *chunk,
-    long long *max_cartesian_x,
-    long long *min_cartesian_x,
-    long long *max_cartesian_y,
-    long long *min_cartesian_y,
+/*
+ * Uses the HeightMap stored in a legacy chunk, the lowest y with full sky light for every column, as its heightmap.
+ * That is one above the highest block that blocks light, which includes leaves and water, but not glass or flowers.
+ * Returns false without touching the heightmap if it can't be used: if it doesn't have 256 values,
+ * or looks stale with values out of range or all of them 0, which is what tools that don't compute it leave behind.
+ */
+static bool use_stored_height_map(struct chunk_ctx *cctx, const void *data, int32_t length, bool big_endian)
+{
+  if(length != 256) return false;
+
+  int32_t values[256];
+  memcpy(values, data, sizeof(values));
+  bool any = false;
+  for(size_t i = 0; i < 256; i++)
+  {
+    if(big_endian) values[i] = (int32_t) ntoh32((uint32_t) values[i]);
+    if(values[i] < 0 || values[i] > 256) return false;
+    if(values[i] != 0) any = true;
+  }
+  if(!any) return false;
+
+  for(size_t i = 0; i < 256; i++) cctx->heightmap[i] = values[i] == 0 ? 0 : (uint8_t) (values[i] - 1);
+  return true;
+}
+
+// Forgets the added sections of a chunk that could not be read.
+static void discard_sections(struct chunk_ctx *cctx)
+{
+  for(int y = cctx->top_section_y; y >= 0; y--) cctx->section_blocks[y] = NULL;
+  cctx->top_section_y = -1;
+}
+
+// Whether a chunk's xPos and zPos match the slot it is stored in, and the region if its coordinates are known.
+static bool chunk_in_place(const struct chunk_ctx *cctx, struct chunkpos chunkpos)
+{
+  long long x = chunkpos.x;
+  long long z = chunkpos.z;
+  if((x & 31) != cctx->slot % 32 || (z & 31) != cctx->slot / 32) return false;
+
+  // x - (x & 31) is a multiple of 32, so these divide exactly, also for negative coordinates.
+  return !cctx->has_region_coords || ((x - (x & 31)) / 32 == cctx->region_x && (z - (z & 31)) / 32 == cctx->region_z);
+}
+
+// Outputs the heightmap of a finished chunk, and readies the context for the next one.
+// Returns false without outputting anything if the chunk's position doesn't match where it is stored, see chunk_error().
+static bool output_chunk(struct chunk_ctx *cctx,
+    struct chunkpos chunkpos,
     output_point_func_t output_point,
     void *output_point_aux)
 {
-  assert(max_cartesian_x != NULL);
-  assert(min_cartesian_x != NULL);
-  assert(max_cartesian_y != NULL);
-  assert(min_cartesian_y != NULL);
+  if(!chunk_in_place(cctx, chunkpos))
+  {
+    return chunk_error(cctx, "'xPos' and 'zPos' tags don't match the chunk's place in the region");
+  }
+
+  reduce_sections(cctx);
+
+  long long llchunkx = (long long) chunkpos.x;
+  long long llchunkz = (long long) chunkpos.z;
+  for(size_t i = 0; i < 256; i++)
+  {
+    long long minecraft_z = llchunkz * 16 + (long long) (i / 16);
+    long long cartesian_x = llchunkx * 16 + (long long) (i % 16);
+    long long cartesian_y = 0 - minecraft_z - 1;
+    // Outputs point at absolute cartesian coordinates, so the Minecraft z is now called y and is inverted
+    output_point(cartesian_x, cartesian_y, cctx->heightmap[i], output_point_aux);
+  }
+
+  // Update filled-in data bounds
+  long long new_max_cartesian_x = llchunkx * 16 + 15;
+  long long new_min_cartesian_x = llchunkx * 16;
+  long long new_max_cartesian_y = 0 - (llchunkz * 16 + 15);
+  long long new_min_cartesian_y = 0 - llchunkz * 16;
+  if(new_max_cartesian_x > cctx->max_cartesian_x) cctx->max_cartesian_x = new_max_cartesian_x;
+  if(new_min_cartesian_x < cctx->min_cartesian_x) cctx->min_cartesian_x = new_min_cartesian_x;
+  if(new_max_cartesian_y > cctx->max_cartesian_y) cctx->max_cartesian_y = new_max_cartesian_y;
+  if(new_min_cartesian_y < cctx->min_cartesian_y) cctx->min_cartesian_y = new_min_cartesian_y;
+
+  // Reset current chunk heightmap
+  clear_columns(cctx);
+  return true;
+}
+
+/*
+ * Outputs a chunk parsed into a tree, from its stored heightmap if it has a usable one and those are used.
+ * Sets 'done' to false, without outputting anything, if it would need the sections but 'with_sections' says
+ * they weren't parsed. Returns false if the chunk can't be used, see chunk_error().
+ */
+static bool handle_chunk(struct chunk_ctx *cctx,
+    nbt_node *chunk,
+    bool with_sections,
+    bool *done,
+    output_point_func_t output_point,
+    void *output_point_aux)
+{
+  assert(cctx != NULL);
   assert(output_point != NULL);
   assert(chunk != NULL);
 
-  nbt_node *level = nbt_find_by_name(chunk, "Level");
-  if(level == NULL)
+  const struct nbt_selection *fields = nbt_select(cctx->selector, chunk);
+  if(fields == NULL)
   {
-    fprintf(stderr, "Could not find 'Level' tag in 'Chunk' compound.");
+    fprintf(stderr, "Could not look up chunk tags. (%s)\n", nbt_error_to_string(errno));
     exit(EXIT_FAILURE);
   }
 
-  nbt_node *x_pos = nbt_find_by_name(level, "xPos");
+  if(fields[CHUNK_FIELD_LEVEL].nodes[0] == NULL)
+  {
+    return chunk_error(cctx, "Could not find 'Level' tag in 'Chunk' compound");
+  }
+
+  nbt_node *x_pos = fields[CHUNK_FIELD_X_POS].nodes[0];
   if(x_pos == NULL)
   {
-    fprintf(stderr, "Could not find 'xPos' tag in 'Chunk' compound.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "Could not find 'xPos' tag in 'Chunk' compound");
   }
   if(x_pos->type != TAG_INT)
   {
-    fprintf(stderr, "'xPos' tag in 'Chunk' compound is not of type TAG_INT.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'xPos' tag in 'Chunk' compound is not of type TAG_INT");
   }
 
-  nbt_node *z_pos = nbt_find_by_name(level, "zPos");
+  nbt_node *z_pos = fields[CHUNK_FIELD_Z_POS].nodes[0];
   if(z_pos == NULL)
   {
-    fprintf(stderr, "Could not find 'zPos' tag in 'Chunk' compound.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "Could not find 'zPos' tag in 'Chunk' compound");
   }
   if(z_pos->type != TAG_INT)
   {
-    fprintf(stderr, "'zPos' tag in 'Chunk' compound is not of type TAG_INT.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'zPos' tag in 'Chunk' compound is not of type TAG_INT");
   }
 
   struct chunkpos chunkpos;
   chunkpos.x = x_pos->payload.tag_int;
   chunkpos.z = z_pos->payload.tag_int;
 
-  nbt_node *sections = nbt_find_by_name(level, "Sections");
+  nbt_node *height_map = fields[CHUNK_FIELD_HEIGHT_MAP].nodes[0];
+  if(cctx->use_height_map && height_map != NULL && height_map->type == TAG_INT_ARRAY &&
+      use_stored_height_map(cctx, height_map->payload.tag_int_array.data, height_map->payload.tag_int_array.length,
+        height_map->payload.tag_int_array.big_endian))
+  {
+    *done = true;
+    return output_chunk(cctx, chunkpos, output_point, output_point_aux);
+  }
+  if(!with_sections)
+  {
+    *done = false;
+    return true;
+  }
+
+  nbt_node *sections = fields[CHUNK_FIELD_SECTIONS].nodes[0];
   if(sections == NULL)
   {
-    fprintf(stderr, "Could not find 'Sections' tag in 'Level' compound.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "Could not find 'Sections' tag in 'Level' compound");
   }
   if(sections->type != TAG_LIST)
   {
-    fprintf(stderr, "'Sections' tag in 'Level' compound is not of type TAG_LIST.");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'Sections' tag in 'Level' compound is not of type TAG_LIST");
   }
 
-  nbt_map(sections, handle_section, NULL);
-
-  for(size_t i = 0; i < 256; i++)
+  const struct nbt_selection *section = &fields[CHUNK_FIELD_SECTION];
+  for(size_t i = 0; i < section->count; i++)
   {
-    long long minecraft_z = chunkpos.z * 16 + i / 16;
-    long long cartesian_x = chunkpos.x * 16 + i % 16;
-    long long cartesian_y = 0 - minecraft_z - 1;
-    // Outputs point at absolute cartesian coordinates, so the Minecraft z is now called y and is inverted
-    output_point(cartesian_x, cartesian_y, current_chunk_heightmap[i], output_point_aux);
+    if(!handle_section(cctx, section->nodes[i],
+          fields[CHUNK_FIELD_SECTION_Y].nodes[i],
+          fields[CHUNK_FIELD_SECTION_BLOCKS].nodes[i]))
+      return false;
   }
 
-  // Update filled-in data bounds
-  long long llchunkx = (long long) chunkpos.x;
-  long long llchunkz = (long long) chunkpos.z;
-  long long new_max_cartesian_x = llchunkx * 16 + 15;
-  long long new_min_cartesian_x = llchunkx * 16;
-  long long new_max_cartesian_y = 0 - (llchunkz * 16 + 15);
-  long long new_min_cartesian_y = 0 - llchunkz * 16;
-  if(new_max_cartesian_x > *max_cartesian_x) *max_cartesian_x = new_max_cartesian_x;
-  if(new_min_cartesian_x < *min_cartesian_x) *min_cartesian_x = new_min_cartesian_x;
-  if(new_max_cartesian_y > *max_cartesian_y) *max_cartesian_y = new_max_cartesian_y;
-  if(new_min_cartesian_y < *min_cartesian_y) *min_cartesian_y = new_min_cartesian_y;
-
-  // Reset current chunk heightmap
-  memset(current_chunk_heightmap, 0, 256);
-  last_section_y = -1;
+  *done = true;
+  return output_chunk(cctx, chunkpos, output_point, output_point_aux);
 }
 
+/*
+ * Parses the tags a DEM needs into a tree, leaving out the sections at first when a stored heightmap may do.
+ * Returns false if the chunk can't be used, see chunk_error(), or if its NBT is malformed,
+ * errno is then set to the nbt_status.
+ */
+static bool tree_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux)
+{
+  bool done = false;
+  if(cctx->use_height_map)
+  {
+    nbt_node *chunk = nbt_parse_paths(cctx->arena, nbt, length, height_map_paths);
+    bool ok = chunk != NULL && handle_chunk(cctx, chunk, false, &done, output_point, output_point_aux);
+    nbt_arena_reset(cctx->arena);
+    if(!ok) return false;
+  }
+
+  if(!done)
+  {
+    nbt_node *chunk = nbt_parse_paths(cctx->arena, nbt, length, chunk_paths);
+    bool ok = chunk != NULL && handle_chunk(cctx, chunk, true, &done, output_point, output_point_aux);
+    nbt_arena_reset(cctx->arena);
+    if(!ok) return false;
+  }
+  return true;
+}
 
-static bool handle_section(nbt_node *section, unused_ void *aux)
+// Returns false if the section can't be used, see chunk_error().
+static bool handle_section(struct chunk_ctx *cctx, nbt_node *section, nbt_node *section_y_nbt, nbt_node *blocks)
 {
-  if((section->name != NULL &&
-      strcmp(section->name, "Sections") == 0) ||
-      section->type != TAG_COMPOUND) return true; // Ignore the root element
+  if(section->type != TAG_COMPOUND) return true;
 
-  nbt_node *section_y_nbt = nbt_find_by_name(section, "Y");
   if(section_y_nbt == NULL)
   {
-    fprintf(stderr, "Could not find 'Y' tag in chunk section.\n");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "Could not find 'Y' tag in chunk section");
   }
   if(section_y_nbt->type != TAG_BYTE)
   {
-    fprintf(stderr, "'Y' tag in chunk section is not of type TAG_BYTE.\n");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'Y' tag in chunk section is not of type TAG_BYTE");
   }
   int8_t section_y = section_y_nbt->payload.tag_byte;
-  if(section_y <= last_section_y)
-  {
-    return true;
-  }
-  else
-  {
-    last_section_y = section_y;
-  }
-  nbt_node *blocks = nbt_find_by_name(section, "Blocks");
+  if(!wants_section(cctx, section_y)) return true;
+
   if(blocks == NULL)
   {
-    fprintf(stderr, "Could not find 'Blocks' tag in chunk section.\n");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "Could not find 'Blocks' tag in chunk section");
   }
   else if(blocks->type != TAG_BYTE_ARRAY)
   {
-    fprintf(stderr, "'Blocks' tag in chunk section is not of type TAG_BYTE_ARRAY.\n");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'Blocks' tag in chunk section is not of type TAG_BYTE_ARRAY");
   }
   else if(blocks->payload.tag_byte_array.length != 4096)
   {
-    fprintf(stderr, "'Blocks' byte array length is not 4096.\n");
-    exit(EXIT_FAILURE);
+    return chunk_error(cctx, "'Blocks' byte array length is not 4096");
   }
-  for(int y = 15; y >= 0; y--)
+  add_section(cctx, section_y, blocks->payload.tag_byte_array.data);
+  return true;
+}
+
+
+// Like chunk_error(), but stops the scan.
+static nbt_scan_action scan_error(struct chunk_ctx *cctx, const char *reason)
+{
+  cctx->error = reason;
+  return NBT_SCAN_STOP;
+}
+
+/*
+ * The scanner only descends into Level, its Sections list and the section compounds in there.
+ * Every other tag is stepped over by its length, and Blocks arrays are read in place.
+ *
+ * depth 0: root compound
+ * depth 1: Level
+ * depth 2: xPos, zPos, HeightMap, Sections
+ * depth 3: section compounds
+ * depth 4: Y, Blocks
+ *
+ * A chunk that can't be used stops the scan, with the reason in cctx->error.
+ */
+
+static nbt_scan_action scan_chunk_enter(const struct nbt_scan_tag *tag, void *aux)
+{
+  struct chunk_ctx *cctx = aux;
+  struct chunk_scan *scan = &cctx->scan;
+
+  switch(tag->depth)
   {
-    uint_fast8_t current_y = section_y * 16 + y;
-    for(uint_fast16_t j = 0; j < 256; j++)
-    {
-      uint8_t current_block_id = (uint8_t) blocks->payload.tag_byte_array.data[y * 256 + j];
+    case 0:
+      return tag->type == TAG_COMPOUND ? NBT_SCAN_CONTINUE : NBT_SCAN_STOP;
 
-      if(is_ground_func(current_block_id) && current_chunk_heightmap[j] < current_y)
+    case 1:
+      if(!nbt_scan_name_is(tag, "Level") || tag->type != TAG_COMPOUND) return NBT_SCAN_SKIP;
+      scan->has_level = true;
+      scan->in_level = true;
+      return NBT_SCAN_CONTINUE;
+
+    case 2:
+      if(!scan->in_level) return NBT_SCAN_SKIP;
+      if(nbt_scan_name_is(tag, "xPos"))
+      {
+        if(tag->type != TAG_INT)
+        {
+          return scan_error(cctx, "'xPos' tag in 'Chunk' compound is not of type TAG_INT");
+        }
+        scan->has_x_pos = true;
+        scan->x_pos = tag->payload.tag_int;
+      }
+      else if(nbt_scan_name_is(tag, "zPos"))
+      {
+        if(tag->type != TAG_INT)
+        {
+          return scan_error(cctx, "'zPos' tag in 'Chunk' compound is not of type TAG_INT");
+        }
+        scan->has_z_pos = true;
+        scan->z_pos = tag->payload.tag_int;
+      }
+      else if(nbt_scan_name_is(tag, "HeightMap"))
+      {
+        if(cctx->use_height_map && tag->type == TAG_INT_ARRAY)
+          scan->has_height_map = use_stored_height_map(cctx, tag->payload.tag_array.data, tag->payload.tag_array.length, true);
+      }
+      else if(nbt_scan_name_is(tag, "Sections"))
+      {
+        if(tag->type != TAG_LIST)
+        {
+          return scan_error(cctx, "'Sections' tag in 'Level' compound is not of type TAG_LIST");
+        }
+        scan->has_sections = true;
+        // Chunks usually store their heightmap before their sections, which then don't have to be looked at.
+        if(scan->has_height_map) return NBT_SCAN_SKIP;
+        scan->in_sections = true;
+        return NBT_SCAN_CONTINUE;
+      }
+      return NBT_SCAN_SKIP;
+
+    case 3:
+      if(!scan->in_sections || tag->type != TAG_COMPOUND) return NBT_SCAN_SKIP;
+      scan->has_section_y = false;
+      scan->blocks = NULL;
+      return NBT_SCAN_CONTINUE;
+
+    case 4:
+      if(nbt_scan_name_is(tag, "Y"))
       {
-        current_chunk_heightmap[j] = current_y;
+        if(tag->type != TAG_BYTE)
+        {
+          return scan_error(cctx, "'Y' tag in chunk section is not of type TAG_BYTE");
+        }
+        scan->has_section_y = true;
+        scan->section_y = tag->payload.tag_byte;
       }
+      else if(nbt_scan_name_is(tag, "Blocks"))
+      {
+        if(tag->type != TAG_BYTE_ARRAY)
+        {
+          return scan_error(cctx, "'Blocks' tag in chunk section is not of type TAG_BYTE_ARRAY");
+        }
+        if(tag->payload.tag_array.length != 4096)
+        {
+          return scan_error(cctx, "'Blocks' byte array length is not 4096");
+        }
+        scan->blocks = tag->payload.tag_array.data;
+      }
+      return NBT_SCAN_SKIP;
+
+    default:
+      return NBT_SCAN_SKIP;
+  }
+}
+
+static nbt_scan_action scan_chunk_leave(const struct nbt_scan_tag *tag, void *aux)
+{
+  struct chunk_ctx *cctx = aux;
+  struct chunk_scan *scan = &cctx->scan;
+
+  if(tag->depth == 1 && scan->in_level)
+  {
+    // Nothing of interest lives outside of Level.
+    scan->in_level = false;
+    return NBT_SCAN_STOP;
+  }
+  else if(tag->depth == 2)
+  {
+    scan->in_sections = false;
+  }
+  else if(tag->depth == 3 && scan->in_sections)
+  {
+    if(!scan->has_section_y)
+    {
+      return scan_error(cctx, "Could not find 'Y' tag in chunk section");
+    }
+    if(!wants_section(cctx, scan->section_y)) return NBT_SCAN_CONTINUE;
+    if(scan->blocks == NULL)
+    {
+      return scan_error(cctx, "Could not find 'Blocks' tag in chunk section");
     }
+    add_section(cctx, scan->section_y, scan->blocks);
+  }
+  return NBT_SCAN_CONTINUE;
+}
+
+// Returns false if the chunk can't be used, see chunk_error(), or if its NBT is malformed,
+// errno is then set to the nbt_status.
+static bool scan_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux)
+{
+  assert(cctx != NULL);
+  assert(output_point != NULL);
+  assert(nbt != NULL);
+
+  static const struct nbt_scan_callbacks callbacks = {
+    .enter = scan_chunk_enter,
+    .leave = scan_chunk_leave,
+  };
+
+  memset(&cctx->scan, 0, sizeof(cctx->scan));
+  if(nbt_scan(nbt, length, &callbacks, cctx) != NBT_OK || cctx->error != NULL) return false;
+
+  struct chunk_scan *scan = &cctx->scan;
+  if(!scan->has_level)
+  {
+    return chunk_error(cctx, "Could not find 'Level' tag in 'Chunk' compound");
+  }
+  if(!scan->has_x_pos)
+  {
+    return chunk_error(cctx, "Could not find 'xPos' tag in 'Chunk' compound");
+  }
+  if(!scan->has_z_pos)
+  {
+    return chunk_error(cctx, "Could not find 'zPos' tag in 'Chunk' compound");
+  }
+  if(scan->has_height_map)
+  {
+    // Sections found before the heightmap aren't needed after all.
+    discard_sections(cctx);
+  }
+  else if(!scan->has_sections)
+  {
+    return chunk_error(cctx, "Could not find 'Sections' tag in 'Level' compound");
+  }
+
+  struct chunkpos chunkpos;
+  chunkpos.x = scan->x_pos;
+  chunkpos.z = scan->z_pos;
+  return output_chunk(cctx, chunkpos, output_point, output_point_aux);
+}
+
+/*
+ * Reads a tag of a fixed size straight from the indexed chunk, checking its type first.
+ * Returns false if the tag is missing or of another type.
+ */
+static bool tape_int(const struct nbt_tape *tape, size_t index, nbt_type type, int32_t *value)
+{
+  if(index == NBT_TAPE_NONE || tape->entries[index].type != type) return false;
+
+  const uint8_t *payload = tape->memory + tape->entries[index].payload;
+  if(type == TAG_BYTE)
+  {
+    *value = (int8_t) payload[0];
+  }
+  else
+  {
+    uint32_t v;
+    memcpy(&v, payload, sizeof(v));
+    *value = (int32_t) ntoh32(v);
   }
   return true;
 }
+
+/*
+ * Indexes the chunk in one pass, then reads the few tags a DEM needs off the tape.
+ * Returns false if the chunk can't be used, see chunk_error(), or if its NBT is malformed,
+ * errno is then set to the nbt_status.
+ */
+static bool tape_chunk(struct chunk_ctx *cctx,
+    const void *nbt, size_t length,
+    output_point_func_t output_point,
+    void *output_point_aux)
+{
+  assert(cctx != NULL);
+  assert(output_point != NULL);
+  assert(nbt != NULL);
+
+  struct nbt_tape *tape = cctx->tape;
+  if(nbt_tape_index(tape, nbt, length) != NBT_OK) return false;
+
+  size_t level = nbt_tape_child(tape, 0, "Level");
+  if(level == NBT_TAPE_NONE)
+  {
+    return chunk_error(cctx, "Could not find 'Level' tag in 'Chunk' compound");
+  }
+
+  struct chunkpos chunkpos;
+  size_t x_pos = nbt_tape_child(tape, level, "xPos");
+  if(x_pos == NBT_TAPE_NONE)
+  {
+    return chunk_error(cctx, "Could not find 'xPos' tag in 'Chunk' compound");
+  }
+  if(!tape_int(tape, x_pos, TAG_INT, &chunkpos.x))
+  {
+    return chunk_error(cctx, "'xPos' tag in 'Chunk' compound is not of type TAG_INT");
+  }
+
+  size_t z_pos = nbt_tape_child(tape, level, "zPos");
+  if(z_pos == NBT_TAPE_NONE)
+  {
+    return chunk_error(cctx, "Could not find 'zPos' tag in 'Chunk' compound");
+  }
+  if(!tape_int(tape, z_pos, TAG_INT, &chunkpos.z))
+  {
+    return chunk_error(cctx, "'zPos' tag in 'Chunk' compound is not of type TAG_INT");
+  }
+
+  if(cctx->use_height_map)
+  {
+    size_t height_map = nbt_tape_child(tape, level, "HeightMap");
+    if(height_map != NBT_TAPE_NONE && tape->entries[height_map].type == TAG_INT_ARRAY &&
+        use_stored_height_map(cctx, tape->memory + tape->entries[height_map].payload, tape->entries[height_map].length, true))
+    {
+      return output_chunk(cctx, chunkpos, output_point, output_point_aux);
+    }
+  }
+
+  size_t sections = nbt_tape_child(tape, level, "Sections");
+  if(sections == NBT_TAPE_NONE)
+  {
+    return chunk_error(cctx, "Could not find 'Sections' tag in 'Level' compound");
+  }
+  if(tape->entries[sections].type != TAG_LIST)
+  {
+    return chunk_error(cctx, "'Sections' tag in 'Level' compound is not of type TAG_LIST");
+  }
+
+  // The sections follow their list on the tape, each one's 'next' skips over its contents.
+  for(size_t section = sections + 1; section < tape->entries[sections].next; section = tape->entries[section].next)
+  {
+    if(tape->entries[section].type != TAG_COMPOUND) continue;
+
+    int32_t section_y;
+    size_t y = nbt_tape_child(tape, section, "Y");
+    if(y == NBT_TAPE_NONE)
+    {
+      return chunk_error(cctx, "Could not find 'Y' tag in chunk section");
+    }
+    if(!tape_int(tape, y, TAG_BYTE, &section_y))
+    {
+      return chunk_error(cctx, "'Y' tag in chunk section is not of type TAG_BYTE");
+    }
+    if(!wants_section(cctx, section_y)) continue;
+
+    size_t blocks = nbt_tape_child(tape, section, "Blocks");
+    if(blocks == NBT_TAPE_NONE)
+    {
+      return chunk_error(cctx, "Could not find 'Blocks' tag in chunk section");
+    }
+    else if(tape->entries[blocks].type != TAG_BYTE_ARRAY)
+    {
+      return chunk_error(cctx, "'Blocks' tag in chunk section is not of type TAG_BYTE_ARRAY");
+    }
+    else if(tape->entries[blocks].length != 4096)
+    {
+      return chunk_error(cctx, "'Blocks' byte array length is not 4096");
+    }
+    add_section(cctx, (int8_t) section_y, tape->memory + tape->entries[blocks].payload);
+  }
+
+  return output_chunk(cctx, chunkpos, output_point, output_point_aux);
+}
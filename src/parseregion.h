@@ -23,29 +23,140 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "columnheight.h"
+
 
 typedef void (*output_point_func_t)(long long cartesian_x, long long cartesian_y, uint8_t height, void *aux);
 
 
 /*
- * Whether a block type should be ignored or not when calculating block column height
- * This is useful for example when you want to exclude leaves and logs (trees) from the resulting DEM.
+ * How chunk NBT is read.
+ * CHUNK_PARSER_SCAN streams over the NBT and only looks at the tags a DEM needs, without allocating.
+ * CHUNK_PARSER_TREE builds an NBT tree of the tags a DEM needs first, skipping the rest of the chunk.
+ * CHUNK_PARSER_TAPE indexes every tag of a chunk into a flat array first, then reads the needed ones from it.
+ */
+enum chunk_parser
+{
+  CHUNK_PARSER_SCAN,
+  CHUNK_PARSER_TREE,
+  CHUNK_PARSER_TAPE
+};
+
+/*
+ * Where a chunk scan is, and what it has found so far.
  */
-typedef bool (*is_ground_func_t)(uint8_t block_id);
+struct chunk_scan
+{
+  bool has_level;
+  bool in_level;
+  bool in_sections;
+
+  bool has_x_pos;
+  bool has_z_pos;
+  bool has_sections;
+  int32_t x_pos;
+  int32_t z_pos;
+
+  // Set once a usable stored heightmap has been read into the chunk context.
+  bool has_height_map;
+
+  // The section compound currently being scanned.
+  bool has_section_y;
+  int8_t section_y;
+  const uint8_t *blocks;
+};
+
+/*
+ * Scratch space of a single thread while it is parsing chunks.
+ */
+struct chunk_ctx
+{
+  // A copy per thread, they are looked up for every block.
+  struct ground_blocks ground;
+  struct ground_bitset ground_bitset;
+
+  // Whether a usable HeightMap stored in a chunk is used instead of its sections.
+  bool use_height_map;
+
+  // Reused for every chunk, so that decompression doesn't allocate once warmed up.
+  struct nbt_decompressor *decompressor;
+
+  // Holds the tree of the current chunk when building trees, reset after every chunk.
+  // Its arrays point into the decompressed chunk rather than being copied.
+  struct nbt_arena *arena;
+
+  // Finds the tags handle_chunk needs in a tree from the arena in one go.
+  struct nbt_selector *selector;
+
+  // Index of the current chunk when reading chunks from a tape, reused for every chunk.
+  struct nbt_tape *tape;
+
+  uint8_t heightmap[256];
+  uint8_t columns_found[256];
+
+  // The Blocks arrays of the current chunk's sections by Y, reduced from the top down once the chunk has been read.
+  const uint8_t *section_blocks[128];
+  int top_section_y; // -1 if there are none
+
+  struct chunk_scan scan;
+
+  // Where the current chunk is stored: its slot in the location table, and the region's coordinates if they're known.
+  uint16_t slot;
+  bool has_region_coords;
+  long long region_x;
+  long long region_z;
+
+  // Why the current chunk can't be used, or NULL if it's its NBT that's malformed, errno says how then.
+  const char *error;
+
+  // Bounds of the chunks parsed with this context during the current region.
+  long long max_cartesian_x;
+  long long min_cartesian_x;
+  long long max_cartesian_y;
+  long long min_cartesian_y;
+};
+
+/*
+ * Holds all state that is needed while parsing regions, so that regions can be parsed on several threads at once.
+ * A context can be reused for any amount of regions, but must only be used by one thread at a time.
+ * Initialize it with parse_ctx_init() and release it with parse_ctx_destroy().
+ */
+struct parse_ctx
+{
+  enum chunk_parser parser;
+  bool use_height_map;
+
+  // The chunks of a region are spread over this many threads, each with their own chunk context.
+  unsigned int threads;
+  struct chunk_ctx *chunk_ctxs;
+};
 
+// 'threads' is the amount of threads used to parse the chunks of a single region, 1 parses them on the calling thread.
+// With 'use_height_map', the HeightMap stored in legacy chunks is used where it can be, which is the highest block
+// that blocks light for every column, and 'ground' only for chunks without a usable one. 'ground' should then
+// be the blocks that block light, so that those chunks agree with the rest.
+// This function will abort the program if memory could not be allocated.
+void parse_ctx_init(struct parse_ctx *ctx, const struct ground_blocks *ground, bool use_height_map,
+    unsigned int threads, enum chunk_parser parser);
+void parse_ctx_destroy(struct parse_ctx *ctx);
 
 // buf size should be at least 4096.
 // 'size' is the amount of available bytes in buf, thus it should be at least 4096.
 
 // the cartesian output bounds should already be initialized when passed to parse_region
 // if they yet have no meaningful content, you can initialize them to LLONG_MAX and LLONG_MIN respectably.
-void parse_region(const uint8_t *buf, const size_t size,
+// If the context uses several threads, output_point_func is called from all of them,
+// but never twice for the same point.
+// 'filepath' is the path buf was read from, it is used to find external chunk files and may be NULL.
+// Chunks that can't be read are skipped with a warning on stderr.
+void parse_region(struct parse_ctx *ctx,
+    const uint8_t *buf, const size_t size,
+    const char *filepath,
     long long *out_max_cartesian_x,
     long long *out_min_cartesian_x,
     long long *out_max_cartesian_y,
     long long *out_min_cartesian_y,
-  output_point_func_t output_point_func,
-    void *aux,
-    is_ground_func_t is_ground_func);
+    output_point_func_t output_point_func,
+    void *aux);
 
 #endif
@@ -27,10 +27,13 @@
 #include <assert.h>
 #include <inttypes.h> // only needed for output_point_func_wkt, remove when done with debugging
 
+#include "parsingutils.h"
 #include "parseregion.h"
+#include "regionfile.h"
 #include "utils.h"
 #include "constants.h"
 #include "conversions.h"
+#include "world.h"
 
 struct auxdata
 {
@@ -38,6 +41,13 @@ struct auxdata
   size_t size;
 };
 
+// The part of a mosaic a single region file may write to, in cartesian coordinates.
+struct mosaic_window
+{
+  struct mosaic *mosaic;
+  struct lli_bounds bounds;
+};
+
 
 /*
  * outbuf should be initialized to zero before calling this function the first time.
@@ -86,10 +96,35 @@ void output_point_func(long long x, long long y, uint8_t height, void *aux)
   outbuf[index] = height;
 }
 
+/*
+ * Like output_point_func, but for a mosaic instead of a single region.
+ * aux must point to a struct mosaic_window, points outside of it are left out.
+ * parse_region() has already skipped the chunks of other regions with a warning, as the window comes from the
+ * same file name. This keeps whatever gets past that out of the pixels of regions parsed on other threads.
+ */
+void mosaic_output_point_func(long long x, long long y, uint8_t height, void *aux)
+{
+  assert(aux != NULL);
+
+  struct mosaic_window *window = (struct mosaic_window *) aux;
+  struct mosaic *mosaic = window->mosaic;
+  assert(mosaic->outbuf != NULL);
+
+  if(x < window->bounds.minx || x > window->bounds.maxx || y < window->bounds.miny || y > window->bounds.maxy) return;
+
+  long long xdiff = x - mosaic->origin_x;
+  long long ydiff = mosaic->origin_y - y;
+
+  size_t index = (size_t) ydiff * mosaic->width + (size_t) xdiff;
+  assert(mosaic->outbuf[index] == 0);
+
+  mosaic->outbuf[index] = height;
+}
+
 /*
  * outbuf must be at least of size REGION_SIZE.
  */
-void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t inbuf_size, is_ground_func_t is_ground_func,
+void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t inbuf_size, const char *filepath, struct parse_ctx *ctx,
     long long *out_region_x,
     long long *out_region_y)
 {
@@ -97,7 +132,7 @@ void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t inbuf_size, is_gro
   assert(out_region_x != NULL);
   assert(out_region_y != NULL);
   assert(inbuf != NULL);
-  assert(is_ground_func != NULL);
+  assert(ctx != NULL);
 
   // These will get continuously updated as they are passed to parse_region()
   long long maxx = LLONG_MIN;
@@ -106,14 +141,13 @@ void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t inbuf_size, is_gro
   long long miny = LLONG_MAX;
   struct auxdata aux = { outbuf, REGION_SIZE };
 
-  parse_region(inbuf, inbuf_size,
+  parse_region(ctx, inbuf, inbuf_size, filepath,
       &maxx,
       &minx,
       &maxy,
       &miny,
       output_point_func,
-      &aux,
-      is_ground_func);
+      &aux);
 
   struct lli_xy result = region_coords(minx, miny);
   *out_region_x = result.x;
@@ -121,36 +155,72 @@ void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t inbuf_size, is_gro
 }
 
 
-#define BUF_SIZE 52428800ULL
-static uint8_t buf[BUF_SIZE];
-
-void regionfile2dem(uint8_t *outbuf, const char *filepath, is_ground_func_t is_ground_func,
+bool regionfile2dem(uint8_t *outbuf, const char *filepath, enum region_reader reader, struct parse_ctx *ctx,
     long long *out_region_x,
     long long *out_region_y)
 {
   fprintf(stderr, "handling %s\n", filepath);
-  FILE *fp = fopen(filepath, "r");
 
-  if(fp == NULL)
+  struct region_file rf;
+  if(!region_file_open(&rf, filepath, reader))
   {
-    fprintf(stderr, "Could not open file '%s'. (%s)", filepath, strerror(errno));
-    exit(EXIT_FAILURE);
+    fprintf(stderr, "Warning: region file '%s' is smaller than 4096 bytes. Skipping file.\n", filepath);
+    return false;
   }
 
-  // important not to swap 1 and BUF_SIZE around.because otherwise if(filesize < 4096) would become bugged
-  size_t filesize = fread(buf, 1, BUF_SIZE, fp);
-  if(filesize == 0)
+  region2dem(outbuf, rf.data, rf.size, filepath, ctx, out_region_x, out_region_y);
+
+  region_file_close(&rf);
+  return true;
+}
+
+void regionfile2mosaic(struct mosaic *mosaic, const char *filepath, enum region_reader reader, struct parse_ctx *ctx)
+{
+  assert(mosaic != NULL);
+  assert(filepath != NULL);
+  assert(ctx != NULL);
+
+  fprintf(stderr, "handling %s\n", filepath);
+
+  const char *filename = strrchr(filepath, '/');
+  filename = filename != NULL ? filename + 1 : filepath;
+  long long region_x;
+  long long region_z;
+  if(!region_filename_coords(filename, &region_x, &region_z))
   {
-    fprintf(stderr, "Could not read from file. (%s)\n", strerror(errno));
-    exit(EXIT_FAILURE);
+    fprintf(stderr, "Warning: could not tell where region file '%s' lies from its name. Skipping file.\n", filepath);
+    return;
   }
 
-  if(filesize < 4096)
+  // Minecraft's z axis points south, cartesian y points north.
+  struct mosaic_window window = { .mosaic = mosaic, .bounds = region_bounds(region_x, -region_z - 1) };
+  if(window.bounds.minx < mosaic->origin_x || window.bounds.maxy > mosaic->origin_y ||
+      (unsigned long long) (window.bounds.maxx - mosaic->origin_x) >= mosaic->width ||
+      (unsigned long long) (mosaic->origin_y - window.bounds.miny) >= mosaic->height)
   {
-    fprintf(stderr, "region file is not at least 4096 bytes. This could indicate a corrupt region file.\n");
-    exit(EXIT_FAILURE);
+    fprintf(stderr, "Warning: region file '%s' lies outside of the mosaic. Skipping file.\n", filepath);
+    return;
   }
 
-  region2dem(outbuf, buf, filesize, is_ground_func, out_region_x, out_region_y);
-}
+  struct region_file rf;
+  if(!region_file_open(&rf, filepath, reader))
+  {
+    fprintf(stderr, "Warning: region file '%s' is smaller than 4096 bytes. Skipping file.\n", filepath);
+    return;
+  }
 
+  long long maxx = LLONG_MIN;
+  long long minx = LLONG_MAX;
+  long long maxy = LLONG_MIN;
+  long long miny = LLONG_MAX;
+
+  parse_region(ctx, rf.data, rf.size, filepath,
+      &maxx,
+      &minx,
+      &maxy,
+      &miny,
+      mosaic_output_point_func,
+      &window);
+
+  region_file_close(&rf);
+}
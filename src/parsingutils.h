@@ -22,15 +22,42 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#include "parseregion.h" // for is_ground_func_t
+#include "parseregion.h" // for struct parse_ctx
+#include "regionfile.h" // for enum region_reader
 
 
-//void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t size, is_ground_func_t is_ground_func,
+//void region2dem(uint8_t *outbuf, const uint8_t *inbuf, size_t size, const char *filepath, struct parse_ctx *ctx,
     //long long *out_cartesian_region_x,
     //long long *out_cartesian_region_y);
 
-void regionfile2dem(uint8_t *outbuf, const char *filepath, is_ground_func_t is_ground_func,
+/*
+ * Parses a region file into 'outbuf', which must be at least of size REGION_SIZE.
+ * Returns false, after a warning, if the file is too short to be a region file.
+ */
+bool regionfile2dem(uint8_t *outbuf, const char *filepath, enum region_reader reader, struct parse_ctx *ctx,
     long long *out_cartesian_region_x,
     long long*out_cartesian_region_y);
 
+/*
+ * A DEM spanning any amount of regions, one byte per block column.
+ * The top-left (north-west) pixel of 'outbuf' lies at cartesian coordinates (origin_x, origin_y).
+ */
+struct mosaic
+{
+  uint8_t *outbuf;
+  long long origin_x;
+  long long origin_y;
+  size_t width;
+  size_t height;
+};
+
+/*
+ * Parses a region file into its part of the mosaic, the 512x512 pixels its "r.<x>.<z>.mca" name stands for.
+ * Files without such a name, whose part lies outside of the mosaic, or that are too short to be region files,
+ * are skipped with a warning.
+ * The mosaic's outbuf should be initialized to zero.
+ * Different region files can be parsed into the same mosaic at the same time.
+ */
+void regionfile2mosaic(struct mosaic *mosaic, const char *filepath, enum region_reader reader, struct parse_ctx *ctx);
+
 #endif
@@ -0,0 +1,251 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "regionfile.h"
+
+
+static int compare_chunk_locations(const void *a, const void *b)
+{
+  const struct chunk_location *first = a;
+  const struct chunk_location *second = b;
+  if(first->sector_offset < second->sector_offset) return -1;
+  if(first->sector_offset > second->sector_offset) return 1;
+  return 0;
+}
+
+size_t region_chunk_locations(const uint8_t *header, struct chunk_location out[REGION_CHUNK_COUNT])
+{
+  assert(header != NULL);
+  assert(out != NULL);
+
+  size_t count = 0;
+  for(uint16_t slot = 0; slot < REGION_CHUNK_COUNT; slot++)
+  {
+    const uint8_t *entry = header + slot * 4;
+    uint32_t sector_offset = ((uint32_t) entry[0] << 16) | ((uint32_t) entry[1] << 8) | entry[2];
+    uint32_t sector_count = entry[3];
+
+    if(sector_offset == 0 && sector_count == 0) continue; // Chunk hasn't been generated yet.
+
+    out[count].sector_offset = sector_offset;
+    out[count].sector_count = sector_count;
+    out[count].slot = slot;
+    count++;
+  }
+
+  qsort(out, count, sizeof(*out), compare_chunk_locations);
+  return count;
+}
+
+// Reads exactly 'count' bytes at 'offset', unless the end of the file is reached first.
+// Returns the amount of bytes read, or -1 on error.
+static ssize_t pread_full(int fd, uint8_t *buf, size_t count, off_t offset)
+{
+  size_t total = 0;
+  while(total < count)
+  {
+    ssize_t result = pread(fd, buf + total, count - total, offset + total);
+    if(result == -1)
+    {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    if(result == 0) break; // End of file
+    total += result;
+  }
+  return total;
+}
+
+bool region_file_open(struct region_file *rf, const char *filepath, enum region_reader reader)
+{
+  switch(reader)
+  {
+    case REGION_READER_MMAP:
+      return region_file_map(rf, filepath);
+    case REGION_READER_PREAD:
+      return region_file_read_sparse(rf, filepath);
+  }
+  return false;
+}
+
+
+bool region_file_map(struct region_file *rf, const char *filepath)
+{
+  assert(rf != NULL);
+  assert(filepath != NULL);
+
+  int fd = open(filepath, O_RDONLY);
+  if(fd == -1)
+  {
+    fprintf(stderr, "Could not open file '%s'. (%s)\n", filepath, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) == -1)
+  {
+    fprintf(stderr, "Could not stat file '%s'. (%s)\n", filepath, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // Too short to hold a location table, this could indicate a corrupt region file.
+  if(st.st_size < REGION_SECTOR_SIZE)
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t) st.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(mapping == MAP_FAILED)
+  {
+    fprintf(stderr, "Could not map file '%s' into memory. (%s)\n", filepath, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+
+  // Chunks are parsed front to back, so ask the kernel to read ahead aggressively.
+  // These are only hints, failure is harmless.
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  madvise(mapping, size, MADV_WILLNEED);
+
+  rf->data = mapping;
+  rf->size = size;
+  rf->mapping = mapping;
+  rf->mapping_size = size;
+  rf->buffer = NULL;
+  return true;
+}
+
+bool region_file_read_sparse(struct region_file *rf, const char *filepath)
+{
+  assert(rf != NULL);
+  assert(filepath != NULL);
+
+  int fd = open(filepath, O_RDONLY);
+  if(fd == -1)
+  {
+    fprintf(stderr, "Could not open file '%s'. (%s)\n", filepath, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) == -1)
+  {
+    fprintf(stderr, "Could not stat file '%s'. (%s)\n", filepath, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  uint8_t header[REGION_SECTOR_SIZE];
+  ssize_t header_size = pread_full(fd, header, sizeof(header), 0);
+  if(header_size == -1)
+  {
+    fprintf(stderr, "Could not read from file. (%s)\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if(header_size < REGION_SECTOR_SIZE)
+  {
+    close(fd);
+    return false;
+  }
+
+  struct chunk_location locations[REGION_CHUNK_COUNT];
+  size_t location_count = region_chunk_locations(header, locations);
+
+  // The view only has to extend up to the end of the last chunk, which may lie before the end of the file.
+  // The last sector of a file is not always padded, so never go past the end of the file either.
+  size_t file_size = (size_t) st.st_size;
+  size_t size = REGION_SECTOR_SIZE;
+  for(size_t i = 0; i < location_count; i++)
+  {
+    size_t end = ((size_t) locations[i].sector_offset + locations[i].sector_count) * REGION_SECTOR_SIZE;
+    if(end > size) size = end;
+  }
+  if(size > file_size) size = file_size;
+
+  // calloc() gives us zeroed pages that are only backed by memory once touched, so dead sectors cost nothing.
+  uint8_t *buffer = calloc(size, 1);
+  if(buffer == NULL)
+  {
+    fprintf(stderr, "Could not allocate buffer for region file. (%s)\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  memcpy(buffer, header, REGION_SECTOR_SIZE);
+
+  // Locations are sorted by offset, so adjacent chunks can be merged into a single read.
+  size_t i = 0;
+  while(i < location_count)
+  {
+    size_t start = (size_t) locations[i].sector_offset * REGION_SECTOR_SIZE;
+    size_t end = start + (size_t) locations[i].sector_count * REGION_SECTOR_SIZE;
+    i++;
+    while(i < location_count && (size_t) locations[i].sector_offset * REGION_SECTOR_SIZE <= end)
+    {
+      size_t next_end = ((size_t) locations[i].sector_offset + locations[i].sector_count) * REGION_SECTOR_SIZE;
+      if(next_end > end) end = next_end;
+      i++;
+    }
+
+    if(start < REGION_SECTOR_SIZE) start = REGION_SECTOR_SIZE; // Already read the location table
+    if(end > size) end = size;
+    if(start >= end) continue;
+
+    if(pread_full(fd, buffer + start, end - start, start) == -1)
+    {
+      fprintf(stderr, "Could not read from file. (%s)\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  close(fd);
+
+  rf->data = buffer;
+  rf->size = size;
+  rf->mapping = NULL;
+  rf->mapping_size = 0;
+  rf->buffer = buffer;
+  return true;
+}
+
+void region_file_close(struct region_file *rf)
+{
+  assert(rf != NULL);
+
+  if(rf->mapping != NULL) munmap(rf->mapping, rf->mapping_size);
+  free(rf->buffer);
+
+  rf->data = NULL;
+  rf->size = 0;
+  rf->mapping = NULL;
+  rf->mapping_size = 0;
+  rf->buffer = NULL;
+}
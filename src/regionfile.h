@@ -0,0 +1,96 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NIN_ANVIL_REGIONFILE_H
+#define NIN_ANVIL_REGIONFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define REGION_SECTOR_SIZE 4096
+#define REGION_CHUNK_COUNT 1024
+
+enum region_reader
+{
+  REGION_READER_MMAP,   // Map the whole file into memory.
+  REGION_READER_PREAD,  // Only read the location table and the sectors of existing chunks.
+};
+
+/*
+ * A read-only view of the contents of a region file.
+ * Only 'data' and 'size' are meant to be accessed, the rest is internal.
+ */
+struct region_file
+{
+  const uint8_t *data;
+  size_t size;
+
+  void *mapping;
+  size_t mapping_size;
+  uint8_t *buffer;
+};
+
+/*
+ * An entry of the location table at the start of a region file.
+ * 'slot' is the index of the entry in the table, which is (z % 32) * 32 + (x % 32).
+ */
+struct chunk_location
+{
+  uint32_t sector_offset;
+  uint32_t sector_count;
+  uint16_t slot;
+};
+
+/*
+ * Reads the location table 'header' (the first 4096 bytes of a region file) into 'out'.
+ * Chunks that have not been generated yet are left out, the remaining entries are sorted by sector offset.
+ * Returns the amount of entries written to 'out'.
+ */
+size_t region_chunk_locations(const uint8_t *header, struct chunk_location out[REGION_CHUNK_COUNT]);
+
+/*
+ * Opens the file at 'filepath' with the given reader.
+ * The resulting view is at least 4096 bytes in size.
+ * Returns false if the file is too short to be a region file, 'rf' is left untouched then.
+ * This function will abort the program if the file could not be read.
+ */
+bool region_file_open(struct region_file *rf, const char *filepath, enum region_reader reader);
+
+/*
+ * Maps the file at 'filepath' read-only into memory, without copying it.
+ * Returns false if the file is smaller than 4096 bytes.
+ * This function will abort the program if the file could not be opened or mapped.
+ */
+bool region_file_map(struct region_file *rf, const char *filepath);
+
+/*
+ * Reads the location table of the file at 'filepath', followed by only the sectors that belong to existing chunks.
+ * Adjacent sector ranges are read with a single pread() call. Sectors that are not read appear as zeroes in the view.
+ * Returns false if the file is smaller than 4096 bytes.
+ * This function will abort the program if the file could not be opened or read.
+ */
+bool region_file_read_sparse(struct region_file *rf, const char *filepath);
+
+/*
+ * Releases all resources associated with 'rf'.
+ * The view must not be accessed anymore after calling this.
+ */
+void region_file_close(struct region_file *rf);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include <pthread.h>
+
+#include "threadpool.h"
+
+struct pool
+{
+  atomic_size_t next;
+  size_t count;
+  parallel_func_t func;
+  void *aux;
+};
+
+struct worker
+{
+  struct pool *pool;
+  unsigned int id;
+  pthread_t thread;
+};
+
+static void *work(void *arg)
+{
+  struct worker *worker = arg;
+  struct pool *pool = worker->pool;
+
+  for(;;)
+  {
+    size_t index = atomic_fetch_add(&pool->next, 1);
+    if(index >= pool->count) break;
+    pool->func(index, worker->id, pool->aux);
+  }
+  return NULL;
+}
+
+void parallel_for(size_t count, unsigned int workers, parallel_func_t func, void *aux)
+{
+  assert(func != NULL);
+
+  if(workers > count) workers = count;
+  if(workers <= 1)
+  {
+    for(size_t i = 0; i < count; i++) func(i, 0, aux);
+    return;
+  }
+
+  struct pool pool = { .count = count, .func = func, .aux = aux };
+  atomic_init(&pool.next, 0);
+
+  struct worker threads[workers];
+  for(unsigned int i = 0; i < workers; i++)
+  {
+    threads[i].pool = &pool;
+    threads[i].id = i;
+
+    // The calling thread is worker 0.
+    if(i == 0) continue;
+
+    int result = pthread_create(&threads[i].thread, NULL, work, &threads[i]);
+    if(result != 0)
+    {
+      fprintf(stderr, "Could not create worker thread. (%s)\n", strerror(result));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  work(&threads[0]);
+
+  for(unsigned int i = 1; i < workers; i++) pthread_join(threads[i].thread, NULL);
+}
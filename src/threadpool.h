@@ -0,0 +1,40 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NIN_ANVIL_THREADPOOL_H
+#define NIN_ANVIL_THREADPOOL_H
+
+#include <stddef.h>
+
+
+/*
+ * 'index' is the job to perform, 'worker' identifies the thread performing it.
+ * 'worker' is always less than the amount of workers passed to parallel_for,
+ * and no two jobs with the same 'worker' run at the same time,
+ * so it can be used to index per-thread scratch space.
+ */
+typedef void (*parallel_func_t)(size_t index, unsigned int worker, void *aux);
+
+/*
+ * Calls 'func' once for every index in [0, count), spread over at most 'workers' threads.
+ * Jobs are handed out in ascending order. Returns when all jobs have finished.
+ * If 'workers' is 1 or less, everything runs on the calling thread.
+ */
+void parallel_for(size_t count, unsigned int workers, parallel_func_t func, void *aux);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "world.h"
+
+
+// Parses a signed decimal number at *str and advances *str past it.
+static bool scan_coordinate(const char **str, long long *out)
+{
+  const char *start = *str;
+  char *end;
+  if(*start != '-' && (*start < '0' || *start > '9')) return false;
+
+  errno = 0;
+  long long value = strtoll(start, &end, 10);
+  if(errno != 0 || end == start) return false;
+
+  *out = value;
+  *str = end;
+  return true;
+}
+
+bool region_filename_coords(const char *filename, long long *out_x, long long *out_z)
+{
+  assert(filename != NULL);
+  assert(out_x != NULL);
+  assert(out_z != NULL);
+
+  const char *p = filename;
+  long long x;
+  long long z;
+
+  if(!string_starts_with(p, "r.")) return false;
+  p += 2;
+  if(!scan_coordinate(&p, &x)) return false;
+  if(*p++ != '.') return false;
+  if(!scan_coordinate(&p, &z)) return false;
+  if(!streq(p, ".mca")) return false;
+
+  // Chunk positions are 32-bit, so no chunk can lie in a region further out than this.
+  if(x < INT32_MIN / 32 || x > INT32_MAX / 32 || z < INT32_MIN / 32 || z > INT32_MAX / 32) return false;
+
+  *out_x = x;
+  *out_z = z;
+  return true;
+}
+
+char *world_region_dir(const char *world_path, enum dimension dimension)
+{
+  assert(world_path != NULL);
+
+  const char *subdir = "region";
+  switch(dimension)
+  {
+    case DIMENSION_OVERWORLD: subdir = "region"; break;
+    case DIMENSION_NETHER: subdir = "DIM-1/region"; break;
+    case DIMENSION_END: subdir = "DIM1/region"; break;
+  }
+
+  char *path;
+  if(asprintf(&path, "%s/%s", world_path, subdir) == -1)
+  {
+    fprintf(stderr, "Could not generate region directory path.\n");
+    exit(EXIT_FAILURE);
+  }
+  return path;
+}
+
+static int compare_world_regions(const void *a, const void *b)
+{
+  const struct world_region *first = a;
+  const struct world_region *second = b;
+  if(first->z != second->z) return first->z < second->z ? -1 : 1;
+  if(first->x != second->x) return first->x < second->x ? -1 : 1;
+  return 0;
+}
+
+void world_scan(struct world *world, const char *region_dir)
+{
+  assert(world != NULL);
+  assert(region_dir != NULL);
+
+  DIR *dir = opendir(region_dir);
+  if(dir == NULL)
+  {
+    fprintf(stderr, "Could not open directory '%s'. (%s)\n", region_dir, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  struct world_region *regions = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+
+  struct dirent *entry;
+  while((entry = readdir(dir)) != NULL)
+  {
+    long long x;
+    long long z;
+    if(!region_filename_coords(entry->d_name, &x, &z)) continue;
+
+    struct stat st;
+    if(fstatat(dirfd(dir), entry->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) continue;
+
+    if(count == capacity)
+    {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      struct world_region *new_regions = realloc(regions, capacity * sizeof(*regions));
+      if(new_regions == NULL)
+      {
+        fprintf(stderr, "Could not allocate region list. (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      regions = new_regions;
+    }
+
+    struct world_region *region = &regions[count++];
+    region->x = x;
+    region->z = z;
+    if(asprintf(&region->path, "%s/%s", region_dir, entry->d_name) == -1)
+    {
+      fprintf(stderr, "Could not generate region file path.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  closedir(dir);
+
+  qsort(regions, count, sizeof(*regions), compare_world_regions);
+
+  world->regions = regions;
+  world->region_count = count;
+  world->min_x = 0;
+  world->max_x = 0;
+  world->min_z = 0;
+  world->max_z = 0;
+  for(size_t i = 0; i < count; i++)
+  {
+    if(i == 0 || regions[i].x < world->min_x) world->min_x = regions[i].x;
+    if(i == 0 || regions[i].x > world->max_x) world->max_x = regions[i].x;
+    if(i == 0 || regions[i].z < world->min_z) world->min_z = regions[i].z;
+    if(i == 0 || regions[i].z > world->max_z) world->max_z = regions[i].z;
+  }
+}
+
+void world_free(struct world *world)
+{
+  assert(world != NULL);
+
+  for(size_t i = 0; i < world->region_count; i++) free(world->regions[i].path);
+  free(world->regions);
+
+  world->regions = NULL;
+  world->region_count = 0;
+}
@@ -0,0 +1,76 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NIN_ANVIL_WORLD_H
+#define NIN_ANVIL_WORLD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum dimension
+{
+  DIMENSION_OVERWORLD,  // region/
+  DIMENSION_NETHER,     // DIM-1/region/
+  DIMENSION_END,        // DIM1/region/
+};
+
+/*
+ * A region file found in a world.
+ * Coordinates are Minecraft region coordinates, as found in the file name, not cartesian ones.
+ */
+struct world_region
+{
+  long long x;
+  long long z;
+  char *path;
+};
+
+struct world
+{
+  struct world_region *regions; // Sorted by z, then by x.
+  size_t region_count;
+
+  // Bounds of all region coordinates, only meaningful if region_count > 0.
+  long long min_x;
+  long long max_x;
+  long long min_z;
+  long long max_z;
+};
+
+/*
+ * Parses a region file name of the form "r.<x>.<z>.mca".
+ * Returns false if 'filename' is not a region file name, or names a region no chunk can lie in.
+ */
+bool region_filename_coords(const char *filename, long long *out_x, long long *out_z);
+
+/*
+ * Returns the directory containing the region files of 'dimension' in the world at 'world_path'.
+ * The returned string must be freed by the caller.
+ */
+char *world_region_dir(const char *world_path, enum dimension dimension);
+
+/*
+ * Finds every region file in 'region_dir'. Coordinates are taken from the file names alone.
+ * Empty region files, which Minecraft sometimes leaves behind, are skipped.
+ * This function will abort the program if the directory could not be read.
+ */
+void world_scan(struct world *world, const char *region_dir);
+
+void world_free(struct world *world);
+
+#endif
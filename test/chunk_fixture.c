@@ -0,0 +1,297 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "chunk_fixture.h"
+
+static void put(struct buffer *b, const void *data, size_t n)
+{
+    if (buffer_append(b, data, n)) abort();
+}
+
+static void put_u8(struct buffer *b, uint8_t v)
+{
+    put(b, &v, 1);
+}
+
+static void put_be16(struct buffer *b, uint16_t v)
+{
+    unsigned char bytes[2] = { (unsigned char) (v >> 8), (unsigned char) v };
+    put(b, bytes, sizeof(bytes));
+}
+
+static void put_be32(struct buffer *b, uint32_t v)
+{
+    put_be16(b, (uint16_t) (v >> 16));
+    put_be16(b, (uint16_t) v);
+}
+
+static void put_be64(struct buffer *b, uint64_t v)
+{
+    put_be32(b, (uint32_t) (v >> 32));
+    put_be32(b, (uint32_t) v);
+}
+
+static void put_double(struct buffer *b, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_be64(b, bits);
+}
+
+static void put_float(struct buffer *b, float v)
+{
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_be32(b, bits);
+}
+
+static void put_string(struct buffer *b, const char *s)
+{
+    put_be16(b, (uint16_t) strlen(s));
+    put(b, s, strlen(s));
+}
+
+// The type and name of a named tag, its payload follows.
+static void put_tag(struct buffer *b, uint8_t type, const char *name)
+{
+    put_u8(b, type);
+    put_string(b, name);
+}
+
+static void put_list(struct buffer *b, const char *name, uint8_t item_type, int32_t length)
+{
+    if (name != NULL) put_tag(b, 9, name);
+    put_u8(b, item_type);
+    put_be32(b, (uint32_t) length);
+}
+
+static void put_end(struct buffer *b)
+{
+    put_u8(b, 0);
+}
+
+static void put_section(struct buffer *b, int y, int index)
+{
+    put_tag(b, 1, "Y");
+    put_u8(b, (uint8_t) y);
+
+    // Stone and dirt with some ores, leaves and the odd id from the top half mixed in.
+    put_tag(b, 7, "Blocks");
+    put_be32(b, 4096);
+    for (uint32_t i = 0; i < 4096; i++)
+    {
+        uint32_t n = (i * 2654435761u + (uint32_t) y * 40503u) >> 24;
+        put_u8(b, (uint8_t) (n < 160 ? 1 : n < 200 ? 3 : n < 230 ? 18 : n));
+    }
+
+    static const char *const nibble_arrays[] = { "Data", "BlockLight", "SkyLight" };
+    for (size_t k = 0; k < 3; k++)
+    {
+        put_tag(b, 7, nibble_arrays[k]);
+        put_be32(b, 2048);
+        for (uint32_t i = 0; i < 2048; i++) put_u8(b, (uint8_t) (i * 7 + k));
+    }
+
+    if (index == 0)
+    {
+        // As sections have them from 1.13 on.
+        put_tag(b, 12, "BlockStates");
+        put_be32(b, 256);
+        for (uint64_t i = 0; i < 256; i++) put_be64(b, i * 0x9e3779b97f4a7c15u);
+
+        put_list(b, "Palette", 10, 2);
+        put_tag(b, 8, "Name");
+        put_string(b, "minecraft:air");
+        put_end(b);
+        put_tag(b, 8, "Name");
+        put_string(b, "minecraft:stone");
+        put_tag(b, 10, "Properties");
+        put_end(b);
+        put_end(b);
+    }
+}
+
+static void put_zombie(struct buffer *b, double x, double z)
+{
+    put_tag(b, 8, "id");
+    put_string(b, "minecraft:zombie");
+    put_list(b, "Pos", 6, 3);
+    put_double(b, x);
+    put_double(b, 64.0);
+    put_double(b, z);
+    put_list(b, "Motion", 6, 3);
+    put_double(b, 0.0);
+    put_double(b, -0.0784000015258789);
+    put_double(b, 0.0);
+    put_list(b, "Rotation", 5, 2);
+    put_float(b, 123.5f);
+    put_float(b, 0.0f);
+    put_tag(b, 5, "Health");
+    put_float(b, 20.0f);
+    put_tag(b, 2, "Air");
+    put_be16(b, 300);
+    put_tag(b, 1, "OnGround");
+    put_u8(b, 1);
+    put_tag(b, 4, "UUIDMost");
+    put_be64(b, 0x0123456789abcdefu);
+    put_tag(b, 4, "UUIDLeast");
+    put_be64(b, 0xfedcba9876543210u);
+    put_list(b, "ArmorItems", 10, 4);
+    for (int i = 0; i < 4; i++) put_end(b);
+    put_list(b, "Tags", 8, 1);
+    put_string(b, "spawned");
+    put_end(b);
+}
+
+struct buffer chunk_fixture(int x_pos, int z_pos, int sections)
+{
+    struct buffer b = BUFFER_INIT;
+
+    put_tag(&b, 10, "");
+    put_tag(&b, 3, "DataVersion");
+    put_be32(&b, 1343);
+
+    put_tag(&b, 10, "Level");
+    put_tag(&b, 3, "xPos");
+    put_be32(&b, (uint32_t) x_pos);
+    put_tag(&b, 3, "zPos");
+    put_be32(&b, (uint32_t) z_pos);
+    put_tag(&b, 4, "LastUpdate");
+    put_be64(&b, 1234567);
+    put_tag(&b, 1, "LightPopulated");
+    put_u8(&b, 1);
+    put_tag(&b, 1, "TerrainPopulated");
+    put_u8(&b, 1);
+    put_tag(&b, 1, "V");
+    put_u8(&b, 1);
+    put_tag(&b, 4, "InhabitedTime");
+    put_be64(&b, 0);
+
+    put_tag(&b, 7, "Biomes");
+    put_be32(&b, 256);
+    for (int i = 0; i < 256; i++) put_u8(&b, (uint8_t) (i % 3 == 0 ? 4 : 1));
+
+    put_tag(&b, 11, "HeightMap");
+    put_be32(&b, 256);
+    for (int i = 0; i < 256; i++) put_be32(&b, (uint32_t) (sections * 16 - i % 5));
+
+    put_list(&b, "Sections", 10, sections);
+    for (int i = 0; i < sections; i++)
+    {
+        put_section(&b, i, i);
+        put_end(&b);
+    }
+
+    put_list(&b, "Entities", 10, 2);
+    put_zombie(&b, x_pos * 16 + 3.5, z_pos * 16 + 8.25);
+    put_zombie(&b, x_pos * 16 + 12.5, z_pos * 16 + 1.75);
+
+    put_list(&b, "TileEntities", 10, 1);
+    put_tag(&b, 8, "id");
+    put_string(&b, "minecraft:chest");
+    put_tag(&b, 3, "x");
+    put_be32(&b, (uint32_t) (x_pos * 16 + 4));
+    put_tag(&b, 3, "y");
+    put_be32(&b, 70);
+    put_tag(&b, 3, "z");
+    put_be32(&b, (uint32_t) (z_pos * 16 + 9));
+    put_list(&b, "Items", 10, 1);
+    put_tag(&b, 1, "Slot");
+    put_u8(&b, 13);
+    put_tag(&b, 8, "id");
+    put_string(&b, "minecraft:bread");
+    put_tag(&b, 1, "Count");
+    put_u8(&b, 5);
+    put_tag(&b, 2, "Damage");
+    put_be16(&b, 0);
+    put_end(&b);
+    put_end(&b);
+
+    // Minecraft writes empty lists with TAG_End items.
+    put_list(&b, "TileTicks", 0, 0);
+
+    // As chunks have them from 1.13 on, a list of lists of shorts.
+    put_list(&b, "PostProcessing", 9, 16);
+    for (int i = 0; i < 16; i++)
+    {
+        if (i % 4 != 0)
+        {
+            put_list(&b, NULL, 0, 0);
+            continue;
+        }
+        put_list(&b, NULL, 2, 2);
+        put_be16(&b, (uint16_t) (i * 16));
+        put_be16(&b, (uint16_t) (i * 16 + 1));
+    }
+
+    put_end(&b); // Level
+    put_end(&b); // root
+    return b;
+}
+
+static void add_tags(nbt_node *node, int depth, int32_t index, struct buffer *tags)
+{
+    struct fixture_tag tag = { .node = node, .depth = depth, .index = index };
+    put(tags, &tag, sizeof(tag));
+
+    if (node->type != TAG_LIST && node->type != TAG_COMPOUND) return;
+
+    struct nbt_list *children = node->type == TAG_LIST ? node->payload.tag_list : node->payload.tag_compound;
+    for (size_t i = 0; i < children->length; i++)
+        add_tags(children->items[i], depth + 1, node->type == TAG_LIST ? (int32_t) i : -1, tags);
+}
+
+size_t fixture_tags(nbt_node *tree, struct fixture_tag **tags)
+{
+    struct buffer b = BUFFER_INIT;
+    add_tags(tree, 0, -1, &b);
+    *tags = (struct fixture_tag *) b.data;
+    return b.len / sizeof(struct fixture_tag);
+}
+
+#define MALFORMED(what, ...) { what, (const unsigned char[]) { __VA_ARGS__ }, sizeof((const unsigned char[]) { __VA_ARGS__ }) }
+
+// All of these are a root compound with a single broken child.
+const struct malformed_nbt malformed_nbt[] = {
+    MALFORMED("byte array longer than the data",
+        10, 0, 0,   7, 0, 1, 'a', 0, 0, 3, 232, 1, 2, 3, 4,   0),
+    MALFORMED("negative byte array length",
+        10, 0, 0,   7, 0, 1, 'a', 255, 255, 255, 255,   0),
+    MALFORMED("int array longer than the data",
+        10, 0, 0,   11, 0, 1, 'i', 0, 0, 0, 16, 0, 0, 0, 1,   0),
+    MALFORMED("negative int array length",
+        10, 0, 0,   11, 0, 1, 'i', 128, 0, 0, 0,   0),
+    MALFORMED("long array longer than the data",
+        10, 0, 0,   12, 0, 1, 'l', 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 1,   0),
+    MALFORMED("string longer than the data",
+        10, 0, 0,   8, 0, 1, 's', 255, 255, 'x',   0),
+    MALFORMED("name longer than the data",
+        10, 0, 0,   1, 255, 255, 'n', 0,   0),
+    MALFORMED("list longer than the data",
+        10, 0, 0,   9, 0, 1, 'l', 3, 127, 255, 255, 255, 0, 0, 0, 1,   0),
+    MALFORMED("list of TAG_End with items",
+        10, 0, 0,   9, 0, 1, 'l', 0, 0, 0, 0, 2,   0),
+    MALFORMED("unknown tag type",
+        10, 0, 0,   13, 0, 1, 'x', 0, 0,   0),
+};
+
+const size_t malformed_nbt_count = sizeof(malformed_nbt) / sizeof(malformed_nbt[0]);
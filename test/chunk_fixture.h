@@ -0,0 +1,65 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNK_FIXTURE_H
+#define CHUNK_FIXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nbt/nbt.h>
+
+/*
+ * Writes the uncompressed NBT of a chunk at (xPos, zPos) as Minecraft 1.12 stores it, with 'sections' sections,
+ * entities, tile entities and an empty tick list. A few tags of later versions are mixed in, so that every tag type,
+ * lists of lists and lists of TAG_End occur in it. The buffer must be freed with buffer_free().
+ */
+struct buffer chunk_fixture(int x_pos, int z_pos, int sections);
+
+/*
+ * A tag of a parsed tree, with where it was found. 'index' is its index in the parent list, -1 otherwise.
+ */
+struct fixture_tag
+{
+    nbt_node *node;
+    int depth;
+    int32_t index;
+};
+
+/*
+ * Lists every tag of 'tree', parents before their contents, in the order they are stored.
+ * Returns the amount of tags, '*tags' must be freed.
+ */
+size_t fixture_tags(nbt_node *tree, struct fixture_tag **tags);
+
+/*
+ * Trees that declare more payload than they hold: array, string and list lengths that run past the end of the data,
+ * negative array lengths, and unknown tag types. Every reader must turn them down. Negative list lengths are not in
+ * here, they are read as empty lists.
+ */
+struct malformed_nbt
+{
+    const char *what;
+    const unsigned char *data;
+    size_t length;
+};
+
+extern const struct malformed_nbt malformed_nbt[];
+extern const size_t malformed_nbt_count;
+
+#endif
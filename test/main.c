@@ -21,7 +21,16 @@
 #include <setjmp.h>
 #include <cmocka.h>
 
+#include "test_blocklist.h"
+#include "test_columnheight.h"
 #include "test_conversions.h"
+#include "test_nbt_indexing.h"
+#include "test_nbt_loading.h"
+#include "test_nbt_scanning.h"
+#include "test_nbt_selecting.h"
+#include "test_nbt_treeops.h"
+#include "test_regionfile.h"
+#include "test_world.h"
 
 /* A test case that does nothing and succeeds. */
 static void null_test_success(void **state) {
@@ -32,7 +41,41 @@ int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(null_test_success),
         cmocka_unit_test(test_region_coords),
+        cmocka_unit_test(test_region_origin_topleft),
         cmocka_unit_test(test_region_bounds),
+        cmocka_unit_test(test_scan_matches_parse),
+        cmocka_unit_test(test_scan_skip_and_stop),
+        cmocka_unit_test(test_scan_rejects_truncated),
+        cmocka_unit_test(test_scan_rejects_malformed),
+        cmocka_unit_test(test_tape_matches_parse),
+        cmocka_unit_test(test_tape_child_and_subtree),
+        cmocka_unit_test(test_tape_rejects_truncated),
+        cmocka_unit_test(test_tape_rejects_malformed),
+        cmocka_unit_test(test_select_matches_lookup),
+        cmocka_unit_test(test_select_arena),
+        cmocka_unit_test(test_selector_rejects_invalid_paths),
+        cmocka_unit_test(test_parse_paths_limit),
+        cmocka_unit_test(test_walk_order),
+        cmocka_unit_test(test_walk_skip),
+        cmocka_unit_test(test_walk_stop),
+        cmocka_unit_test(test_walk_deep),
+        cmocka_unit_test(test_lz4_known_stream),
+        cmocka_unit_test(test_lz4_chunk),
+        cmocka_unit_test(test_lz4_rejects_oversized_block),
+        cmocka_unit_test(test_lz4_rejects_truncated),
+        cmocka_unit_test(test_lz4_rejects_corrupt),
+        cmocka_unit_test(test_chunk_locations_sorted),
+        cmocka_unit_test(test_chunk_locations_full),
+        cmocka_unit_test(test_region_file_open_short),
+        cmocka_unit_test(test_region_filename_coords),
+        cmocka_unit_test(test_region_filename_coords_invalid),
+        cmocka_unit_test(test_ground_bitset),
+        cmocka_unit_test(test_raise_columns_scalar),
+        cmocka_unit_test(test_raise_columns_sse41),
+        cmocka_unit_test(test_raise_columns_avx2),
+        cmocka_unit_test(test_raise_columns_top_down),
+        cmocka_unit_test(test_read_block_list),
+        cmocka_unit_test(test_read_block_list_invalid),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,112 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "blocklist.h"
+#include "test_blocklist.h"
+
+struct test_list
+{
+    const char *contents;
+    const int ids[8];   // terminated by -1
+};
+
+static const struct test_list valid_lists[] = {
+    { "", { -1 } },
+    { "1 2 3\n", { 1, 2, 3, -1 } },
+    { "0\n255", { 0, 255, -1 } },
+    { "\t 18\n\n  161\t162  \n", { 18, 161, 162, -1 } },
+    { "8\r\n9\r\n", { 8, 9, -1 } },
+    { "007 0", { 0, 7, -1 } },
+    { "# leaves and logs\n18 17 # 300 and -1 are fine in here\n#161\n162#", { 17, 18, 162, -1 } },
+    { "1 1 1", { 1, -1 } },
+};
+
+static const char *const invalid_lists[] = {
+    "256",
+    "1 2\n300\n",
+    "-1",
+    "-0",
+    "+1",
+    "abc",
+    "1a",
+    "1.0",
+    "0x10",
+    "1,2",
+    "18446744073709551617",
+    "00000000000000000000000000000000000000001",
+};
+
+// Writes 'contents' to a new temporary file, whose path is put in 'path'.
+static void write_list(char path[], const char *contents)
+{
+    strcpy(path, "/tmp/anvil2dem_blocklist_XXXXXX");
+    int fd = mkstemp(path);
+    assert_true(fd != -1);
+    size_t length = strlen(contents);
+    assert_int_equal(write(fd, contents, length), (ssize_t) length);
+    close(fd);
+}
+
+void test_read_block_list(void **state)
+{
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(valid_lists) / sizeof(valid_lists[0]); i++)
+    {
+        const struct test_list *test_case = valid_lists + i;
+        char path[64];
+        write_list(path, test_case->contents);
+
+        bool listed[256] = { false };
+        bool result = read_block_list(path, listed);
+        unlink(path);
+        if (!result) fail_msg("'%s' was turned down", test_case->contents);
+
+        bool expected[256] = { false };
+        for (size_t k = 0; test_case->ids[k] != -1; k++) expected[test_case->ids[k]] = true;
+        assert_memory_equal(listed, expected, sizeof(listed));
+    }
+}
+
+void test_read_block_list_invalid(void **state)
+{
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(invalid_lists) / sizeof(invalid_lists[0]); i++)
+    {
+        char path[64];
+        write_list(path, invalid_lists[i]);
+
+        bool listed[256] = { false };
+        bool result = read_block_list(path, listed);
+        unlink(path);
+        if (result) fail_msg("'%s' was taken for a block list", invalid_lists[i]);
+    }
+
+    bool listed[256] = { false };
+    assert_false(read_block_list("/nonexistent/anvil2dem/blocks.txt", listed));
+}
@@ -0,0 +1,291 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+// The kernels are static, so they are tested from here.
+#include "columnheight.c"
+
+#include "test_columnheight.h"
+
+typedef bool (*kernel_func_t)(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset);
+
+static uint32_t random_state = 2463534242u;
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static bool kernel_scalar(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset)
+{
+    (void) bitset;
+    return raise_columns_scalar(heightmap, found, blocks, base_y, ground);
+}
+
+#ifdef HAVE_X86_SIMD
+static bool kernel_sse41(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset)
+{
+    (void) ground;
+    return raise_columns_sse41(heightmap, found, blocks, base_y, bitset);
+}
+
+static bool kernel_avx2(uint8_t heightmap[256], uint8_t found[256], const uint8_t *blocks, uint8_t base_y,
+    const struct ground_blocks *ground, const struct ground_bitset *bitset)
+{
+    (void) ground;
+    return raise_columns_avx2(heightmap, found, blocks, base_y, bitset);
+}
+#endif
+
+// Fills the ground set the 'kind'th way: none, all, single ids, the usual ignored blocks, or at random.
+static void make_ground(struct ground_blocks *ground, int kind)
+{
+    static const uint8_t ignored[] = { 0, 8, 9, 17, 18, 161, 162 };
+
+    for (int id = 0; id < 256; id++)
+    {
+        switch (kind)
+        {
+        case 0: ground->is_ground[id] = false; break;
+        case 1: ground->is_ground[id] = true; break;
+        case 2: ground->is_ground[id] = id == 0 || id == 127 || id == 128 || id == 255; break;
+        case 3: ground->is_ground[id] = id % 17 == 0; break;
+        case 4: ground->is_ground[id] = memchr(ignored, id, sizeof(ignored)) == NULL; break;
+        default: ground->is_ground[id] = next_random() % 8 == 0; break;
+        }
+    }
+}
+
+// Fills the section the 'kind'th way. Every layer holds each of the 256 ids, except in the random ones.
+static void make_blocks(uint8_t blocks[4096], int kind)
+{
+    for (int y = 0; y < 16; y++)
+    {
+        for (int j = 0; j < 256; j++)
+        {
+            switch (kind)
+            {
+            case 0: blocks[y * 256 + j] = (uint8_t) (j + y * 17); break;
+            case 1: blocks[y * 256 + j] = (uint8_t) (j * 7 + y); break;
+            // Air at the top, so the kernels have to go further down.
+            case 2: blocks[y * 256 + j] = y > 9 ? 0 : (uint8_t) (255 - j); break;
+            default: blocks[y * 256 + j] = (uint8_t) next_random(); break;
+            }
+        }
+    }
+}
+
+// Sets up the columns the 'kind'th way: untouched, partly found by sections above, or at random.
+static void make_columns(uint8_t heightmap[256], uint8_t found[256], uint8_t base_y, int kind)
+{
+    for (int j = 0; j < 256; j++)
+    {
+        switch (kind)
+        {
+        case 0:
+            heightmap[j] = 0;
+            found[j] = 0;
+            break;
+        case 1:
+            found[j] = next_random() % 2 ? 0xff : 0;
+            heightmap[j] = found[j] ? (uint8_t) (base_y + 16 + next_random() % 16) : 0;
+            break;
+        case 2:
+            found[j] = j % 64 == 0 ? 0 : 0xff;
+            heightmap[j] = found[j] ? (uint8_t) (base_y + 16) : 0;
+            break;
+        default:
+            found[j] = next_random() % 2 ? 0xff : 0;
+            heightmap[j] = (uint8_t) next_random();
+            break;
+        }
+    }
+}
+
+static void check_kernel(kernel_func_t kernel)
+{
+    static const uint8_t base_ys[] = { 0, 16, 112, 240 };
+    uint8_t blocks[4096];
+    struct ground_blocks ground;
+    struct ground_bitset bitset;
+
+    for (int ground_kind = 0; ground_kind < 8; ground_kind++)
+    {
+        make_ground(&ground, ground_kind);
+        ground_bitset_init(&bitset, &ground);
+
+        for (int blocks_kind = 0; blocks_kind < 6; blocks_kind++)
+        {
+            make_blocks(blocks, blocks_kind);
+
+            for (size_t b = 0; b < sizeof(base_ys); b++)
+            {
+                for (int columns_kind = 0; columns_kind < 5; columns_kind++)
+                {
+                    uint8_t expected_heightmap[256], expected_found[256];
+                    make_columns(expected_heightmap, expected_found, base_ys[b], columns_kind);
+
+                    uint8_t heightmap[256], found[256];
+                    memcpy(heightmap, expected_heightmap, sizeof(heightmap));
+                    memcpy(found, expected_found, sizeof(found));
+
+                    bool expected = raise_columns_scalar(expected_heightmap, expected_found, blocks, base_ys[b], &ground);
+                    bool result = kernel(heightmap, found, blocks, base_ys[b], &ground, &bitset);
+
+                    assert_int_equal(result, expected);
+                    assert_memory_equal(heightmap, expected_heightmap, sizeof(heightmap));
+                    assert_memory_equal(found, expected_found, sizeof(found));
+                }
+            }
+        }
+    }
+}
+
+void test_ground_bitset(void **state)
+{
+    (void) state;
+
+    struct ground_blocks ground;
+    struct ground_bitset bitset;
+
+    // Each id on its own must set exactly its own bit.
+    for (int id = 0; id < 256; id++)
+    {
+        memset(&ground, 0, sizeof(ground));
+        ground.is_ground[id] = true;
+        ground_bitset_init(&bitset, &ground);
+
+        for (int other = 0; other < 256; other++)
+        {
+            const uint8_t *bytes = other < 128 ? bitset.low : bitset.high;
+            bool set = bytes[other & 15] >> ((other >> 4) & 7) & 1;
+            assert_int_equal(set, other == id);
+        }
+    }
+}
+
+void test_raise_columns_scalar(void **state)
+{
+    (void) state;
+
+    // Only stone, at a known height in every column.
+    uint8_t blocks[4096] = { 0 };
+    for (int j = 0; j < 256; j++) blocks[(j % 16) * 256 + j] = 1;
+
+    struct ground_blocks ground = { .is_ground = { [1] = true } };
+    uint8_t heightmap[256] = { 0 }, found[256] = { 0 };
+    assert_true(raise_columns_scalar(heightmap, found, blocks, 32, &ground));
+    for (int j = 0; j < 256; j++)
+    {
+        assert_int_equal(heightmap[j], 32 + j % 16);
+        assert_int_equal(found[j], 0xff);
+    }
+
+    // One column of air is left unfound.
+    blocks[15 * 256 + 255] = 0;
+    memset(heightmap, 0, sizeof(heightmap));
+    memset(found, 0, sizeof(found));
+    assert_false(raise_columns_scalar(heightmap, found, blocks, 32, &ground));
+    assert_int_equal(heightmap[255], 0);
+    assert_int_equal(found[255], 0);
+
+    check_kernel(kernel_scalar);
+}
+
+void test_raise_columns_sse41(void **state)
+{
+    (void) state;
+
+#ifdef HAVE_X86_SIMD
+    if (!__builtin_cpu_supports("sse4.1")) skip();
+    check_kernel(kernel_sse41);
+#else
+    skip();
+#endif
+}
+
+void test_raise_columns_avx2(void **state)
+{
+    (void) state;
+
+#ifdef HAVE_X86_SIMD
+    if (!__builtin_cpu_supports("avx2")) skip();
+    check_kernel(kernel_avx2);
+#else
+    skip();
+#endif
+}
+
+void test_raise_columns_top_down(void **state)
+{
+    (void) state;
+
+    enum { SECTIONS = 8 };
+    static uint8_t blocks[SECTIONS][4096];
+    struct ground_blocks ground;
+    struct ground_bitset bitset;
+
+    for (int round = 0; round < 64; round++)
+    {
+        make_ground(&ground, 4 + round % 4);
+        ground_bitset_init(&bitset, &ground);
+
+        // Mostly air, so that some columns only hit ground a few sections down, and some never do.
+        int air_above = round % SECTIONS;
+        for (int s = 0; s < SECTIONS; s++)
+        {
+            make_blocks(blocks[s], 3 + round % 3);
+            if (s >= SECTIONS - air_above) memset(blocks[s], 0, sizeof(blocks[s]));
+            if (round % 5 == 0)
+                for (int i = 0; i < 4096; i++) if (next_random() % 4 != 0) blocks[s][i] = 0;
+        }
+
+        // Looking at every block of every section.
+        uint8_t expected[256] = { 0 };
+        bool expected_found[256] = { false };
+        for (int s = 0; s < SECTIONS; s++)
+            for (int i = 0; i < 4096; i++)
+            {
+                if (!ground.is_ground[blocks[s][i]]) continue;
+                uint8_t y = (uint8_t) (s * 16 + i / 256);
+                if (y > expected[i % 256]) expected[i % 256] = y;
+                expected_found[i % 256] = true;
+            }
+
+        // As the DEM does it: from the top down, stopping once every column has hit ground.
+        uint8_t heightmap[256] = { 0 }, found[256] = { 0 };
+        int s = SECTIONS - 1;
+        while (s >= 0 && !raise_columns(heightmap, found, blocks[s], (uint8_t) (s * 16), &ground, &bitset)) s--;
+
+        assert_memory_equal(heightmap, expected, sizeof(heightmap));
+        for (int j = 0; j < 256; j++) assert_int_equal(found[j] != 0, expected_found[j]);
+    }
+}
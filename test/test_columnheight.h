@@ -0,0 +1,28 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEST_COLUMNHEIGHT_H
+#define TEST_COLUMNHEIGHT_H
+
+void test_ground_bitset(void **state);
+void test_raise_columns_scalar(void **state);
+void test_raise_columns_sse41(void **state);
+void test_raise_columns_avx2(void **state);
+void test_raise_columns_top_down(void **state);
+
+#endif
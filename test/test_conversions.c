@@ -16,13 +16,15 @@
   along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdarg.h>
 #include <stddef.h>
-
-#include "conversions.c"
-
+#include <setjmp.h>
 #include <cmocka.h>
 
-struct test_region 
+#include "conversions.h"
+#include "test_conversions.h"
+
+struct test_region
 {
     long long minx;
     long long maxx;
@@ -40,39 +42,45 @@ struct test_region extremes[] = {
     { .region_x = -1,   .region_y = 0,  .minx = -512ll, .maxx = -1ll,   .miny = 0ll,    .maxy = 511ll },    // topleft quarter, bottomright region
 };
 
-void test_region_coords(void) 
+void test_region_coords(void **state)
 {
-    for (size_t i = 0; i < sizeof(extremes); i++)
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(extremes) / sizeof(extremes[0]); i++)
     {
         struct test_region *test_case = extremes + i;
-        assert_true(lli_xy_equals(region_coords(test_case.minx, test_case.miny), struct lli_xy { .x = test_case.region_x, .y = test_case.region_y}));
-        assert_true(lli_xy_equals(region_coords(test_case.minx, test_case.maxy), struct lli_xy { .x = test_case.region_x, .y = test_case.region_y}));
-        assert_true(lli_xy_equals(region_coords(test_case.maxx, test_case.maxy), struct lli_xy { .x = test_case.region_x, .y = test_case.region_y}));
-        assert_true(lli_xy_equals(region_coords(test_case.maxx, test_case.miny), struct lli_xy { .x = test_case.region_x, .y = test_case.region_y}));
+        assert_true(lli_xy_equals(region_coords(test_case->minx, test_case->miny), (struct lli_xy) { .x = test_case->region_x, .y = test_case->region_y }));
+        assert_true(lli_xy_equals(region_coords(test_case->minx, test_case->maxy), (struct lli_xy) { .x = test_case->region_x, .y = test_case->region_y }));
+        assert_true(lli_xy_equals(region_coords(test_case->maxx, test_case->maxy), (struct lli_xy) { .x = test_case->region_x, .y = test_case->region_y }));
+        assert_true(lli_xy_equals(region_coords(test_case->maxx, test_case->miny), (struct lli_xy) { .x = test_case->region_x, .y = test_case->region_y }));
     }
 }
 
-void test_region_origin_topleft(void) 
+void test_region_origin_topleft(void **state)
 {
-    for (size_t i = 0; i < sizeof(extremes); i++)
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(extremes) / sizeof(extremes[0]); i++)
     {
         struct test_region *test_case = extremes + i;
-        struct lli_xy correct_origin = { .x = test_case.minx, .y = test_case.maxy };
-        assert_true(lli_xy_equals(region_origin_topleft(test_region.region_x, test_region.region_y), correct_origin));
+        struct lli_xy correct_origin = { .x = test_case->minx, .y = test_case->maxy };
+        assert_true(lli_xy_equals(region_origin_topleft(test_case->region_x, test_case->region_y), correct_origin));
     }
 }
 
-void test_region_bounds(void)
+void test_region_bounds(void **state)
 {
-    for (size_t i = 0; i < sizeof(extremes); i++)
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(extremes) / sizeof(extremes[0]); i++)
     {
         struct test_region *test_case = extremes + i;
-        struct lli_bounds correct_bounds = { 
-            .minxx = test_case.minx, 
-            .maxx = test_case.maxx,
-            .miny = test_case.miny, 
-            .maxy = test_case.maxy,
+        struct lli_bounds correct_bounds = {
+            .minx = test_case->minx,
+            .maxx = test_case->maxx,
+            .miny = test_case->miny,
+            .maxy = test_case->maxy,
         };
-        assert_true(lli_bounds_equals(region_bounds(test_region.region_x, test_region.region_y), correct_bounds));
+        assert_true(lli_bounds_equals(region_bounds(test_case->region_x, test_case->region_y), correct_bounds));
     }
 }
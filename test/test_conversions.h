@@ -19,8 +19,8 @@
 #ifndef TEST_CONVERSIONS_H
 #define TEST_CONVERSIONS_H
 
-void test_region_coords(void);
-void test_region_origin_topleft(void);
-void test_region_bounds(void);
+void test_region_coords(void **state);
+void test_region_origin_topleft(void **state);
+void test_region_bounds(void **state);
 
 #endif
@@ -0,0 +1,195 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <nbt/nbt.h>
+
+#include "chunk_fixture.h"
+#include "test_nbt_indexing.h"
+
+// Checks the entries of 'tape' against the tags of the tree nbt_parse built from the same memory.
+static void check_entries(const struct nbt_tape *tape, nbt_node *tree)
+{
+    struct fixture_tag *tags;
+    size_t count = fixture_tags(tree, &tags);
+    assert_int_equal(tape->count, count);
+    assert_int_equal(tape->count, nbt_size(tree));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct nbt_tape_entry *entry = &tape->entries[i];
+        const nbt_node *node = tags[i].node;
+
+        assert_int_equal(entry->type, node->type);
+        if (node->name == NULL || tags[i].index != -1)
+        {
+            assert_int_equal(entry->name, 0);
+        }
+        else
+        {
+            assert_int_equal(entry->name_length, strlen(node->name));
+            assert_memory_equal(tape->memory + entry->name, node->name, entry->name_length);
+        }
+
+        // The next entry is the first one that isn't inside this tag.
+        size_t next = i + 1;
+        while (next < count && tags[next].depth > tags[i].depth) next++;
+        assert_int_equal(entry->next, next);
+
+        switch (node->type)
+        {
+        case TAG_STRING:
+            assert_int_equal(entry->length, strlen(node->payload.tag_string));
+            assert_memory_equal(tape->memory + entry->payload, node->payload.tag_string, (size_t) entry->length);
+            break;
+        case TAG_BYTE_ARRAY:
+            assert_int_equal(entry->length, node->payload.tag_byte_array.length);
+            assert_memory_equal(tape->memory + entry->payload, node->payload.tag_byte_array.data, (size_t) entry->length);
+            break;
+        case TAG_INT_ARRAY:
+            assert_int_equal(entry->length, node->payload.tag_int_array.length);
+            break;
+        case TAG_LONG_ARRAY:
+            assert_int_equal(entry->length, node->payload.tag_long_array.length);
+            break;
+        case TAG_LIST:
+            assert_int_equal(entry->length, node->payload.tag_list->length);
+            if (entry->item_type != TAG_INVALID) assert_int_equal(entry->item_type, node->payload.tag_list->type);
+            break;
+        case TAG_COMPOUND:
+            assert_int_equal(entry->length, node->payload.tag_compound->length);
+            break;
+        default:
+            break;
+        }
+    }
+
+    free(tags);
+}
+
+void test_tape_matches_parse(void **state)
+{
+    (void) state;
+
+    struct buffer big = chunk_fixture(7, -2, 5);
+    struct buffer small = chunk_fixture(7, -2, 1);
+    nbt_node *big_tree = nbt_parse(big.data, big.len);
+    nbt_node *small_tree = nbt_parse(small.data, small.len);
+    assert_non_null(big_tree);
+    assert_non_null(small_tree);
+
+    struct nbt_tape *tape = nbt_tape_new();
+    struct nbt_arena *arena = nbt_arena_new();
+    assert_non_null(tape);
+    assert_non_null(arena);
+
+    // A tape is reused for every chunk, and must not keep anything of the one before.
+    assert_int_equal(nbt_tape_index(tape, big.data, big.len), NBT_OK);
+    check_entries(tape, big_tree);
+    assert_int_equal(nbt_tape_index(tape, small.data, small.len), NBT_OK);
+    check_entries(tape, small_tree);
+    assert_int_equal(nbt_tape_index(tape, big.data, big.len), NBT_OK);
+    check_entries(tape, big_tree);
+
+    nbt_node *node = nbt_tape_node(arena, tape, 0);
+    assert_non_null(node);
+    assert_true(nbt_eq(node, big_tree));
+
+    nbt_tape_free(tape);
+    nbt_arena_free(arena);
+    nbt_free(small_tree);
+    nbt_free(big_tree);
+    buffer_free(&small);
+    buffer_free(&big);
+}
+
+void test_tape_child_and_subtree(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(0, 31, 3);
+    nbt_node *tree = nbt_parse(chunk.data, chunk.len);
+    assert_non_null(tree);
+
+    struct nbt_tape *tape = nbt_tape_new();
+    struct nbt_arena *arena = nbt_arena_new();
+    assert_int_equal(nbt_tape_index(tape, chunk.data, chunk.len), NBT_OK);
+
+    nbt_node *level = nbt_compound_get(tree, "Level");
+    size_t level_index = nbt_tape_child(tape, 0, "Level");
+    assert_int_not_equal(level_index, NBT_TAPE_NONE);
+
+    static const char *const names[] = { "xPos", "HeightMap", "Sections", "Entities", "TileTicks", "PostProcessing" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        size_t index = nbt_tape_child(tape, level_index, names[i]);
+        assert_int_not_equal(index, NBT_TAPE_NONE);
+
+        // Only the subtree is built, and it is the one nbt_parse built.
+        nbt_node *node = nbt_tape_node(arena, tape, index);
+        assert_non_null(node);
+        assert_true(nbt_eq(node, nbt_compound_get(level, names[i])));
+        nbt_arena_reset(arena);
+    }
+
+    assert_int_equal(nbt_tape_child(tape, level_index, "Missing"), NBT_TAPE_NONE);
+    assert_int_equal(nbt_tape_child(tape, level_index, "xPo"), NBT_TAPE_NONE);
+    assert_int_equal(nbt_tape_child(tape, nbt_tape_child(tape, level_index, "xPos"), "Y"), NBT_TAPE_NONE);
+    assert_int_equal(nbt_tape_child(tape, nbt_tape_child(tape, level_index, "Sections"), "Y"), NBT_TAPE_NONE);
+
+    nbt_tape_free(tape);
+    nbt_arena_free(arena);
+    nbt_free(tree);
+    buffer_free(&chunk);
+}
+
+void test_tape_rejects_truncated(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(0, 0, 1);
+    struct nbt_tape *tape = nbt_tape_new();
+    assert_non_null(tape);
+
+    for (size_t length = 0; length < chunk.len; length++)
+        assert_int_equal(nbt_tape_index(tape, chunk.data, length), NBT_ERR);
+    assert_int_equal(nbt_tape_index(tape, chunk.data, chunk.len), NBT_OK);
+
+    nbt_tape_free(tape);
+    buffer_free(&chunk);
+}
+
+void test_tape_rejects_malformed(void **state)
+{
+    (void) state;
+
+    struct nbt_tape *tape = nbt_tape_new();
+    assert_non_null(tape);
+
+    for (size_t i = 0; i < malformed_nbt_count; i++)
+        if (nbt_tape_index(tape, malformed_nbt[i].data, malformed_nbt[i].length) != NBT_ERR)
+            fail_msg("nbt_tape_index accepted a %s", malformed_nbt[i].what);
+
+    nbt_tape_free(tape);
+}
@@ -0,0 +1,235 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <nbt/nbt.h>
+
+#include "chunk_fixture.h"
+#include "test_nbt_loading.h"
+
+#define RAW 0x10
+#define LZ4 0x20
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+// Appends a LZ4Block header and the block as LZ4BlockOutputStream writes them, leaving the checksum at 0.
+static void put_block(struct buffer *b, unsigned char token, const void *data, uint32_t length, uint32_t original_length)
+{
+    unsigned char header[21] = { 'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k', token };
+    put_le32(header + 9, length);
+    put_le32(header + 13, original_length);
+    assert_int_equal(buffer_append(b, header, sizeof(header)), 0);
+    if (length > 0) assert_int_equal(buffer_append(b, data, length), 0);
+}
+
+static void put_end_block(struct buffer *b)
+{
+    put_block(b, RAW, NULL, 0, 0);
+}
+
+// "abc", then a match of 9 at offset 3, then the literal "d".
+static const unsigned char abc_block[] = { 0x35, 'a', 'b', 'c', 3, 0, 0x10, 'd' };
+// "z", then a match of 29 at offset 1 that overlaps itself, with its length in an extra byte, and no last literals.
+static const unsigned char z_block[] = { 0x1f, 'z', 1, 0, 10, 0x00 };
+
+static void put_known_stream(struct buffer *b)
+{
+    put_block(b, LZ4 | 0, abc_block, sizeof(abc_block), 13);
+    put_block(b, RAW | 0, "xyz", 3, 3);
+    put_block(b, LZ4 | 3, z_block, sizeof(z_block), 30);
+    put_end_block(b);
+}
+
+void test_lz4_known_stream(void **state)
+{
+    (void) state;
+
+    struct buffer stream = BUFFER_INIT;
+    put_known_stream(&stream);
+
+    struct nbt_decompressor *dec = nbt_decompressor_new();
+    assert_non_null(dec);
+
+    static const char expected[] = "abcabcabcabcdxyzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz";
+
+    // Twice, as the decompressor's buffer is reused.
+    for (int i = 0; i < 2; i++)
+    {
+        size_t length = 0;
+        const void *out = nbt_decompress_lz4(dec, stream.data, stream.len, &length);
+        assert_non_null(out);
+        assert_int_equal(length, sizeof(expected) - 1);
+        assert_memory_equal(out, expected, length);
+    }
+
+    // Anything after the end of the stream is left alone.
+    assert_int_equal(buffer_append(&stream, "junk", 4), 0);
+    size_t length = 0;
+    assert_non_null(nbt_decompress_lz4(dec, stream.data, stream.len, &length));
+    assert_int_equal(length, sizeof(expected) - 1);
+
+    nbt_decompressor_free(dec);
+    buffer_free(&stream);
+}
+
+void test_lz4_chunk(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(1, 1, 2);
+    nbt_node *tree = nbt_parse(chunk.data, chunk.len);
+    assert_non_null(tree);
+
+    // Raw blocks of level 0, as many as the chunk needs.
+    struct buffer stream = BUFFER_INIT;
+    for (size_t offset = 0; offset < chunk.len; offset += 1024)
+    {
+        uint32_t length = (uint32_t) (chunk.len - offset < 1024 ? chunk.len - offset : 1024);
+        put_block(&stream, RAW | 0, chunk.data + offset, length, length);
+    }
+    put_end_block(&stream);
+
+    struct nbt_decompressor *dec = nbt_decompressor_new();
+    size_t length = 0;
+    const void *out = nbt_decompress_lz4(dec, stream.data, stream.len, &length);
+    assert_non_null(out);
+    assert_int_equal(length, chunk.len);
+
+    nbt_node *decompressed = nbt_parse(out, length);
+    assert_non_null(decompressed);
+    assert_true(nbt_eq(decompressed, tree));
+
+    nbt_free(decompressed);
+    nbt_decompressor_free(dec);
+    buffer_free(&stream);
+    nbt_free(tree);
+    buffer_free(&chunk);
+}
+
+static void check_rejected(const struct buffer *stream)
+{
+    struct nbt_decompressor *dec = nbt_decompressor_new();
+    assert_non_null(dec);
+
+    size_t length = 0;
+    errno = 0;
+    assert_null(nbt_decompress_lz4(dec, stream->data, stream->len, &length));
+    assert_int_equal(errno, NBT_EZ);
+
+    nbt_decompressor_free(dec);
+}
+
+void test_lz4_rejects_oversized_block(void **state)
+{
+    (void) state;
+
+    static unsigned char data[1025];
+    memset(data, 'a', sizeof(data));
+
+    // Level 0 blocks hold 1024 bytes at most, level 1 blocks 2048.
+    struct buffer stream = BUFFER_INIT;
+    put_block(&stream, RAW | 1, data, sizeof(data), sizeof(data));
+    put_end_block(&stream);
+
+    struct nbt_decompressor *dec = nbt_decompressor_new();
+    size_t length = 0;
+    assert_non_null(nbt_decompress_lz4(dec, stream.data, stream.len, &length));
+    assert_int_equal(length, sizeof(data));
+    nbt_decompressor_free(dec);
+    buffer_free(&stream);
+
+    put_block(&stream, RAW | 0, data, sizeof(data), sizeof(data));
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+
+    // An LZ4 block is checked before it is decoded.
+    static const unsigned char long_match[] = { 0x1f, 'a', 1, 0, 255, 255, 255, 255, 0, 0x00 };
+    put_block(&stream, LZ4 | 0, long_match, sizeof(long_match), 1 + 15 + 4 + 4 * 255);
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+}
+
+void test_lz4_rejects_truncated(void **state)
+{
+    (void) state;
+
+    struct buffer stream = BUFFER_INIT;
+    put_known_stream(&stream);
+
+    struct nbt_decompressor *dec = nbt_decompressor_new();
+    for (size_t length = 0; length < stream.len; length++)
+    {
+        size_t out_length = 0;
+        errno = 0;
+        assert_null(nbt_decompress_lz4(dec, stream.data, length, &out_length));
+        assert_int_equal(errno, NBT_EZ);
+    }
+
+    nbt_decompressor_free(dec);
+    buffer_free(&stream);
+}
+
+void test_lz4_rejects_corrupt(void **state)
+{
+    (void) state;
+
+    struct buffer stream = BUFFER_INIT;
+
+    // An unknown method.
+    put_block(&stream, 0x30, "abc", 3, 3);
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+
+    // A raw block that doesn't decompress to its own length.
+    put_block(&stream, RAW, "abc", 3, 4);
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+
+    // A block that decodes to less than its header says.
+    put_block(&stream, LZ4, abc_block, sizeof(abc_block), 14);
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+
+    // A match from before the start of the block.
+    static const unsigned char far_match[] = { 0x30, 'a', 'b', 'c', 4, 0, 0x10, 'd' };
+    put_block(&stream, LZ4, far_match, sizeof(far_match), 11);
+    put_end_block(&stream);
+    check_rejected(&stream);
+    buffer_free(&stream);
+
+    // A bad magic.
+    put_known_stream(&stream);
+    stream.data[0] = 'l';
+    check_rejected(&stream);
+    buffer_free(&stream);
+}
@@ -0,0 +1,28 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEST_NBT_LOADING_H
+#define TEST_NBT_LOADING_H
+
+void test_lz4_known_stream(void **state);
+void test_lz4_chunk(void **state);
+void test_lz4_rejects_oversized_block(void **state);
+void test_lz4_rejects_truncated(void **state);
+void test_lz4_rejects_corrupt(void **state);
+
+#endif
@@ -0,0 +1,227 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <nbt/nbt.h>
+
+#include "chunk_fixture.h"
+#include "test_nbt_scanning.h"
+
+struct scan_check
+{
+    const struct fixture_tag *tags;
+    size_t count;
+    size_t next;
+    size_t leaves;
+};
+
+static uint64_t read_be(const unsigned char *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) v = v << 8 | p[i];
+    return v;
+}
+
+// Checks every scanned tag against the next tag of the tree nbt_parse built.
+static nbt_scan_action check_enter(const struct nbt_scan_tag *tag, void *aux)
+{
+    struct scan_check *check = aux;
+    assert_true(check->next < check->count);
+
+    const struct fixture_tag *expected = &check->tags[check->next++];
+    const nbt_node *node = expected->node;
+
+    assert_int_equal(tag->type, node->type);
+    assert_int_equal(tag->depth, expected->depth);
+    assert_int_equal(tag->index, expected->index);
+    if (node->name == NULL)
+    {
+        assert_null(tag->name);
+    }
+    else
+    {
+        assert_int_equal(tag->name_length, strlen(node->name));
+        assert_memory_equal(tag->name, node->name, tag->name_length);
+    }
+
+    switch (tag->type)
+    {
+    case TAG_BYTE:   assert_int_equal(tag->payload.tag_byte, node->payload.tag_byte); break;
+    case TAG_SHORT:  assert_int_equal(tag->payload.tag_short, node->payload.tag_short); break;
+    case TAG_INT:    assert_int_equal(tag->payload.tag_int, node->payload.tag_int); break;
+    case TAG_LONG:   assert_int_equal(tag->payload.tag_long, node->payload.tag_long); break;
+    case TAG_FLOAT:  assert_true(tag->payload.tag_float == node->payload.tag_float); break;
+    case TAG_DOUBLE: assert_true(tag->payload.tag_double == node->payload.tag_double); break;
+    case TAG_STRING:
+        assert_int_equal(tag->payload.tag_string.length, strlen(node->payload.tag_string));
+        assert_memory_equal(tag->payload.tag_string.data, node->payload.tag_string, tag->payload.tag_string.length);
+        break;
+    case TAG_BYTE_ARRAY:
+        assert_int_equal(tag->payload.tag_array.length, node->payload.tag_byte_array.length);
+        assert_memory_equal(tag->payload.tag_array.data, node->payload.tag_byte_array.data,
+            (size_t) tag->payload.tag_array.length);
+        break;
+    case TAG_INT_ARRAY:
+        assert_int_equal(tag->payload.tag_array.length, node->payload.tag_int_array.length);
+        for (int32_t i = 0; i < tag->payload.tag_array.length; i++)
+            assert_int_equal((int32_t) read_be((const unsigned char *) tag->payload.tag_array.data + i * 4, 4),
+                nbt_int_array_get(&node->payload.tag_int_array, i));
+        break;
+    case TAG_LONG_ARRAY:
+        assert_int_equal(tag->payload.tag_array.length, node->payload.tag_long_array.length);
+        for (int32_t i = 0; i < tag->payload.tag_array.length; i++)
+            assert_int_equal((int64_t) read_be((const unsigned char *) tag->payload.tag_array.data + i * 8, 8),
+                nbt_long_array_get(&node->payload.tag_long_array, i));
+        break;
+    case TAG_LIST:
+        assert_int_equal(tag->payload.tag_list.length, (int32_t) node->payload.tag_list->length);
+        // Trees give empty lists of TAG_End a type of their own.
+        if (tag->payload.tag_list.type != TAG_INVALID)
+            assert_int_equal(tag->payload.tag_list.type, node->payload.tag_list->type);
+        break;
+    default:
+        break;
+    }
+
+    return NBT_SCAN_CONTINUE;
+}
+
+static nbt_scan_action check_leave(const struct nbt_scan_tag *tag, void *aux)
+{
+    struct scan_check *check = aux;
+    assert_true(tag->type == TAG_LIST || tag->type == TAG_COMPOUND);
+    check->leaves++;
+    return NBT_SCAN_CONTINUE;
+}
+
+void test_scan_matches_parse(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(3, -7, 4);
+    nbt_node *tree = nbt_parse(chunk.data, chunk.len);
+    assert_non_null(tree);
+
+    struct fixture_tag *tags;
+    size_t count = fixture_tags(tree, &tags);
+
+    size_t containers = 0;
+    for (size_t i = 0; i < count; i++)
+        if (tags[i].node->type == TAG_LIST || tags[i].node->type == TAG_COMPOUND) containers++;
+
+    struct scan_check check = { .tags = tags, .count = count };
+    const struct nbt_scan_callbacks callbacks = { .enter = check_enter, .leave = check_leave };
+    assert_int_equal(nbt_scan(chunk.data, chunk.len, &callbacks, &check), NBT_OK);
+    assert_int_equal(check.next, count);
+    assert_int_equal(check.leaves, containers);
+
+    free(tags);
+    nbt_free(tree);
+    buffer_free(&chunk);
+}
+
+struct skip_check
+{
+    size_t entered;
+    size_t in_sections;
+    bool saw_entities;
+};
+
+// Skips the sections and stops at the entities.
+static nbt_scan_action skip_enter(const struct nbt_scan_tag *tag, void *aux)
+{
+    struct skip_check *check = aux;
+    check->entered++;
+
+    if (tag->depth > 2 && check->in_sections) check->in_sections++;
+    if (tag->depth == 2 && nbt_scan_name_is(tag, "Sections")) return NBT_SCAN_SKIP;
+    if (tag->depth == 2 && nbt_scan_name_is(tag, "Entities"))
+    {
+        check->saw_entities = true;
+        return NBT_SCAN_STOP;
+    }
+    assert_false(check->saw_entities);
+    return NBT_SCAN_CONTINUE;
+}
+
+static nbt_scan_action skip_leave(const struct nbt_scan_tag *tag, void *aux)
+{
+    (void) aux;
+    // Skipped lists and compounds aren't left, and nothing is after a stop.
+    assert_false(nbt_scan_name_is(tag, "Sections"));
+    assert_false(nbt_scan_name_is(tag, "Level"));
+    return NBT_SCAN_CONTINUE;
+}
+
+void test_scan_skip_and_stop(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(0, 0, 2);
+    struct skip_check check = { 0 };
+    const struct nbt_scan_callbacks callbacks = { .enter = skip_enter, .leave = skip_leave };
+
+    assert_int_equal(nbt_scan(chunk.data, chunk.len, &callbacks, &check), NBT_OK);
+    assert_true(check.saw_entities);
+    assert_int_equal(check.in_sections, 0);
+    // The root, DataVersion, Level, its 10 tags up to Sections, and Entities.
+    assert_int_equal(check.entered, 14);
+
+    buffer_free(&chunk);
+}
+
+void test_scan_rejects_truncated(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(0, 0, 1);
+    const struct nbt_scan_callbacks callbacks = { 0 };
+
+    assert_int_equal(nbt_scan(chunk.data, chunk.len, &callbacks, NULL), NBT_OK);
+    for (size_t length = 0; length < chunk.len; length++)
+        assert_int_equal(nbt_scan(chunk.data, length, &callbacks, NULL), NBT_ERR);
+
+    buffer_free(&chunk);
+}
+
+void test_scan_rejects_malformed(void **state)
+{
+    (void) state;
+
+    const struct nbt_scan_callbacks callbacks = { 0 };
+    for (size_t i = 0; i < malformed_nbt_count; i++)
+    {
+        const struct malformed_nbt *bad = &malformed_nbt[i];
+        if (nbt_scan(bad->data, bad->length, &callbacks, NULL) != NBT_ERR)
+            fail_msg("nbt_scan accepted a %s", bad->what);
+
+        nbt_node *tree = nbt_parse(bad->data, bad->length);
+        if (tree != NULL)
+        {
+            nbt_free(tree);
+            fail_msg("nbt_parse accepted a %s", bad->what);
+        }
+    }
+}
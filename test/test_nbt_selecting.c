@@ -0,0 +1,240 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <nbt/nbt.h>
+
+#include "chunk_fixture.h"
+#include "test_nbt_selecting.h"
+
+static const char *const paths[] = {
+    "DataVersion",
+    "Level.xPos",
+    "Level.zPos",
+    "Level.HeightMap",
+    "Level.Sections",
+    "Level.Sections.",
+    "Level.Sections..Y",
+    "Level.Sections..Blocks",
+    "Level.Sections..Palette",
+    "Level.Sections..Missing",
+    "Level.Entities..Pos",
+    "Level.PostProcessing.",
+    "Level.TileTicks..x",
+    "Level.Missing",
+    "Level.Missing..Y",
+    "Level.xPos.Deeper",
+    NULL
+};
+
+// Follows the compound names of 'path' from 'node', one at a time.
+static nbt_node *lookup(nbt_node *node, const char *path, size_t length)
+{
+    while (node != NULL && length > 0)
+    {
+        const char *dot = memchr(path, '.', length);
+        size_t name_length = dot != NULL ? (size_t) (dot - path) : length;
+
+        char name[64];
+        assert_true(name_length < sizeof(name));
+        memcpy(name, path, name_length);
+        name[name_length] = '\0';
+
+        node = nbt_compound_get(node, name);
+        if (dot == NULL) break;
+        path = dot + 1;
+        length -= name_length + 1;
+    }
+    return node;
+}
+
+// Checks that every selection holds the tags nbt_compound_get finds one by one.
+static void check_selection(nbt_node *tree, const struct nbt_selection *selections)
+{
+    assert_non_null(selections);
+
+    for (size_t i = 0; paths[i] != NULL; i++)
+    {
+        const struct nbt_selection *selection = &selections[i];
+        const char *items = strstr(paths[i], "..");
+        size_t length = strlen(paths[i]);
+        if (items == NULL && paths[i][length - 1] == '.') items = paths[i] + length - 1;
+
+        if (items == NULL)
+        {
+            assert_int_equal(selection->count, 1);
+            assert_ptr_equal(selection->nodes[0], lookup(tree, paths[i], length));
+            continue;
+        }
+
+        nbt_node *list = lookup(tree, paths[i], (size_t) (items - paths[i]));
+        if (list == NULL || list->type != TAG_LIST)
+        {
+            assert_int_equal(selection->count, 0);
+            continue;
+        }
+
+        const char *rest = items[1] == '.' ? items + 2 : items + 1;
+        assert_int_equal(selection->count, list->payload.tag_list->length);
+        for (size_t k = 0; k < selection->count; k++)
+            assert_ptr_equal(selection->nodes[k], lookup(list->payload.tag_list->items[k], rest, strlen(rest)));
+    }
+}
+
+void test_select_matches_lookup(void **state)
+{
+    (void) state;
+
+    struct buffer big = chunk_fixture(5, 9, 4);
+    struct buffer small = chunk_fixture(5, 9, 1);
+
+    nbt_node *big_tree = nbt_parse(big.data, big.len);
+    nbt_node *small_tree = nbt_parse(small.data, small.len);
+    assert_non_null(big_tree);
+    assert_non_null(small_tree);
+
+    struct nbt_selector *selector = nbt_selector_new(NULL, paths);
+    assert_non_null(selector);
+
+    // A selector is reused for every chunk, the selections must follow the list lengths of each.
+    check_selection(big_tree, nbt_select(selector, big_tree));
+    check_selection(small_tree, nbt_select(selector, small_tree));
+    check_selection(big_tree, nbt_select(selector, big_tree));
+
+    const struct nbt_selection *selections = nbt_select(selector, big_tree);
+    assert_int_equal(selections[6].count, 4);
+    assert_int_equal(selections[6].nodes[3]->payload.tag_byte, 3);
+    assert_null(selections[9].nodes[0]);
+    assert_int_equal(selections[12].count, 0);
+    assert_int_equal(selections[14].count, 0);
+
+    nbt_selector_free(selector);
+    nbt_free(small_tree);
+    nbt_free(big_tree);
+    buffer_free(&small);
+    buffer_free(&big);
+}
+
+void test_select_arena(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(-1, 2, 3);
+    struct nbt_arena *arena = nbt_arena_new();
+    assert_non_null(arena);
+
+    struct nbt_selector *selector = nbt_selector_new(arena, paths);
+    assert_non_null(selector);
+
+    // The same selector works on every tree of its arena, across resets.
+    for (int round = 0; round < 3; round++)
+    {
+        nbt_node *tree = round == 1 ? nbt_parse_borrowed(arena, chunk.data, chunk.len)
+                                    : nbt_parse_arena(arena, chunk.data, chunk.len);
+        assert_non_null(tree);
+        check_selection(tree, nbt_select(selector, tree));
+        nbt_arena_reset(arena);
+    }
+
+    nbt_selector_free(selector);
+    nbt_arena_free(arena);
+    buffer_free(&chunk);
+}
+
+void test_selector_rejects_invalid_paths(void **state)
+{
+    (void) state;
+
+    static const char *const empty[] = { "", NULL };
+    static const char *const two_lists[] = { "Level.Sections..Palette..Name", NULL };
+    static const char *const twice[] = { "Level.xPos", "Level.zPos", "Level.xPos", NULL };
+    static const char *const *const invalid[] = { empty, two_lists, twice };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        errno = 0;
+        assert_null(nbt_selector_new(NULL, invalid[i]));
+        assert_int_equal(errno, NBT_ERR);
+    }
+
+    // A step only has room for 64 children.
+    char names[65][8];
+    const char *wide[66];
+    for (int i = 0; i < 65; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "T%d", i);
+        wide[i] = names[i];
+    }
+    wide[64] = NULL;
+
+    struct nbt_selector *selector = nbt_selector_new(NULL, wide);
+    assert_non_null(selector);
+    nbt_selector_free(selector);
+
+    wide[64] = names[64];
+    wide[65] = NULL;
+    errno = 0;
+    assert_null(nbt_selector_new(NULL, wide));
+    assert_int_equal(errno, NBT_ERR);
+}
+
+void test_parse_paths_limit(void **state)
+{
+    (void) state;
+
+    struct buffer chunk = chunk_fixture(5, 9, 1);
+    struct nbt_arena *arena = nbt_arena_new();
+    assert_non_null(arena);
+
+    // Up to 64 paths are followed, the last one too.
+    char names[64][8];
+    const char *many[66];
+    for (int i = 0; i < 63; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "T%d", i);
+        many[i] = names[i];
+    }
+    many[63] = "Level.xPos";
+    many[64] = NULL;
+
+    errno = 0;
+    nbt_node *tree = nbt_parse_paths(arena, chunk.data, chunk.len, many);
+    assert_non_null(tree);
+    assert_int_equal(errno, NBT_OK);
+    nbt_node *x = lookup(tree, "Level.xPos", strlen("Level.xPos"));
+    assert_non_null(x);
+    assert_int_equal(x->payload.tag_int, 5);
+    assert_null(lookup(tree, "Level.zPos", strlen("Level.zPos")));
+    nbt_arena_reset(arena);
+
+    many[64] = "Level.zPos";
+    many[65] = NULL;
+    errno = 0;
+    assert_null(nbt_parse_paths(arena, chunk.data, chunk.len, many));
+    assert_int_equal(errno, NBT_ERR);
+
+    nbt_arena_free(arena);
+    buffer_free(&chunk);
+}
@@ -0,0 +1,145 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <nbt/nbt.h>
+
+#include "chunk_fixture.h"
+#include "test_nbt_treeops.h"
+
+struct walk_check
+{
+    nbt_node *visited[4096];
+    size_t count;
+    const char *skip;
+    const char *stop;
+};
+
+static nbt_visit_action record(nbt_node *node, void *aux)
+{
+    struct walk_check *check = aux;
+    assert_true(check->count < sizeof(check->visited) / sizeof(check->visited[0]));
+    check->visited[check->count++] = node;
+
+    if (node->name != NULL && check->skip != NULL && strcmp(node->name, check->skip) == 0) return NBT_VISIT_SKIP;
+    if (node->name != NULL && check->stop != NULL && strcmp(node->name, check->stop) == 0) return NBT_VISIT_STOP;
+    return NBT_VISIT_CONTINUE;
+}
+
+/*
+ * Walks the tree of a chunk, skipping the contents of 'skip' and stopping at 'stop', and checks that exactly the
+ * tags before the stop and outside the skipped tag were visited, in the order nbt_parse read them.
+ */
+static void check_walk(const char *skip, const char *stop)
+{
+    struct buffer chunk = chunk_fixture(-4, 4, 3);
+    nbt_node *tree = nbt_parse(chunk.data, chunk.len);
+    assert_non_null(tree);
+
+    struct fixture_tag *tags;
+    size_t count = fixture_tags(tree, &tags);
+
+    struct walk_check *check = calloc(1, sizeof(*check));
+    assert_non_null(check);
+    check->skip = skip;
+    check->stop = stop;
+    assert_int_equal(nbt_walk(tree, record, check), NBT_OK);
+
+    size_t visited = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        assert_true(visited < check->count);
+        assert_ptr_equal(check->visited[visited++], tags[i].node);
+
+        const char *name = tags[i].node->name;
+        if (name != NULL && stop != NULL && strcmp(name, stop) == 0) break;
+        if (name != NULL && skip != NULL && strcmp(name, skip) == 0)
+        {
+            int depth = tags[i].depth;
+            while (i + 1 < count && tags[i + 1].depth > depth) i++;
+        }
+    }
+    assert_int_equal(check->count, visited);
+
+    free(check);
+    free(tags);
+    nbt_free(tree);
+    buffer_free(&chunk);
+}
+
+void test_walk_order(void **state)
+{
+    (void) state;
+    check_walk(NULL, NULL);
+}
+
+void test_walk_skip(void **state)
+{
+    (void) state;
+    check_walk("Sections", NULL);
+    check_walk("Level", NULL);
+}
+
+void test_walk_stop(void **state)
+{
+    (void) state;
+    check_walk(NULL, "Entities");
+    check_walk("Sections", "TileTicks");
+}
+
+static nbt_visit_action count_nodes(nbt_node *node, void *aux)
+{
+    size_t *count = aux;
+    (*count)++;
+    // The innermost list holds the only byte.
+    if (node->type == TAG_BYTE) assert_int_equal(node->payload.tag_byte, 42);
+    return NBT_VISIT_CONTINUE;
+}
+
+void test_walk_deep(void **state)
+{
+    (void) state;
+
+    // Lists in lists, far deeper than the walker keeps on its own stack.
+    const size_t depth = 1000;
+    struct buffer b = BUFFER_INIT;
+    static const unsigned char head[] = { 10, 0, 0,   9, 0, 4, 'd', 'e', 'e', 'p' };
+    static const unsigned char list[] = { 9, 0, 0, 0, 1 };
+    static const unsigned char tail[] = { 1, 0, 0, 0, 1, 42,   0 };
+
+    assert_int_equal(buffer_append(&b, head, sizeof(head)), 0);
+    for (size_t i = 1; i < depth; i++) assert_int_equal(buffer_append(&b, list, sizeof(list)), 0);
+    assert_int_equal(buffer_append(&b, tail, sizeof(tail)), 0);
+
+    nbt_node *tree = nbt_parse(b.data, b.len);
+    assert_non_null(tree);
+
+    size_t count = 0;
+    assert_int_equal(nbt_walk(tree, count_nodes, &count), NBT_OK);
+    assert_int_equal(count, nbt_size(tree));
+    assert_int_equal(count, depth + 2);
+
+    nbt_free(tree);
+    buffer_free(&b);
+}
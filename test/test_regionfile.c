@@ -0,0 +1,167 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "regionfile.h"
+#include "test_regionfile.h"
+
+static void set_location(uint8_t *header, uint16_t slot, uint32_t sector_offset, uint8_t sector_count)
+{
+    header[slot * 4] = (uint8_t) (sector_offset >> 16);
+    header[slot * 4 + 1] = (uint8_t) (sector_offset >> 8);
+    header[slot * 4 + 2] = (uint8_t) sector_offset;
+    header[slot * 4 + 3] = sector_count;
+}
+
+// Checks that 'locations' holds every used slot of 'header' once, sorted by sector offset.
+static void check_locations(const uint8_t *header, const struct chunk_location *locations, size_t count)
+{
+    bool seen[REGION_CHUNK_COUNT] = { false };
+    size_t used = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const struct chunk_location *location = &locations[i];
+        const uint8_t *entry = header + location->slot * 4;
+
+        assert_true(location->slot < REGION_CHUNK_COUNT);
+        assert_false(seen[location->slot]);
+        seen[location->slot] = true;
+
+        assert_int_equal(location->sector_offset, (uint32_t) entry[0] << 16 | (uint32_t) entry[1] << 8 | entry[2]);
+        assert_int_equal(location->sector_count, entry[3]);
+        if (i > 0) assert_true(locations[i - 1].sector_offset <= location->sector_offset);
+    }
+
+    for (uint16_t slot = 0; slot < REGION_CHUNK_COUNT; slot++)
+        if (memcmp(header + slot * 4, "\0\0\0\0", 4) != 0) used++;
+    assert_int_equal(count, used);
+}
+
+void test_chunk_locations_sorted(void **state)
+{
+    (void) state;
+
+    uint8_t header[REGION_SECTOR_SIZE] = { 0 };
+    struct chunk_location locations[REGION_CHUNK_COUNT];
+
+    assert_int_equal(region_chunk_locations(header, locations), 0);
+
+    // Chunks are written wherever there's room, so the table isn't in sector order.
+    set_location(header, 1023, 2, 1);
+    set_location(header, 0, 0xffffff, 255);
+    set_location(header, 33, 40, 3);
+    set_location(header, 32, 7, 2);
+    set_location(header, 500, 3, 4);
+    set_location(header, 1, 0x010000, 1);
+    set_location(header, 2, 0x000100, 1);
+    // Only slots that are all zero are empty.
+    set_location(header, 700, 0, 1);
+    set_location(header, 701, 9, 0);
+
+    size_t count = region_chunk_locations(header, locations);
+    assert_int_equal(count, 9);
+    check_locations(header, locations, count);
+
+    assert_int_equal(locations[0].slot, 700);
+    assert_int_equal(locations[1].slot, 1023);
+    assert_int_equal(locations[2].slot, 500);
+    assert_int_equal(locations[8].slot, 0);
+    assert_int_equal(locations[8].sector_offset, 0xffffff);
+    assert_int_equal(locations[8].sector_count, 255);
+}
+
+void test_chunk_locations_full(void **state)
+{
+    (void) state;
+
+    // Every slot in use, in reverse order, some sharing an offset.
+    uint8_t header[REGION_SECTOR_SIZE];
+    for (uint16_t slot = 0; slot < REGION_CHUNK_COUNT; slot++)
+        set_location(header, slot, 2 + (REGION_CHUNK_COUNT - 1 - slot) / 2 * 3, (uint8_t) (1 + slot % 3));
+
+    struct chunk_location locations[REGION_CHUNK_COUNT];
+    size_t count = region_chunk_locations(header, locations);
+    assert_int_equal(count, REGION_CHUNK_COUNT);
+    check_locations(header, locations, count);
+    assert_int_equal(locations[0].sector_offset, 2);
+}
+
+// Writes a region file of 'size' bytes with a single chunk in slot 5 to a new temporary file.
+static void write_region(char path[], size_t size)
+{
+    static uint8_t data[3 * REGION_SECTOR_SIZE];
+    assert_true(size <= sizeof(data));
+    memset(data, 0, sizeof(data));
+    if (size >= REGION_SECTOR_SIZE) set_location(data, 5, 2, 1);
+    for (size_t i = 2 * REGION_SECTOR_SIZE; i < sizeof(data); i++) data[i] = (uint8_t) i;
+
+    strcpy(path, "/tmp/anvil2dem_region_XXXXXX");
+    int fd = mkstemp(path);
+    assert_true(fd != -1);
+    assert_int_equal(write(fd, data, size), (ssize_t) size);
+    close(fd);
+}
+
+void test_region_file_open_short(void **state)
+{
+    (void) state;
+
+    static const size_t sizes[] = { 0, 1, 8, REGION_SECTOR_SIZE - 1 };
+    static const enum region_reader readers[] = { REGION_READER_MMAP, REGION_READER_PREAD };
+
+    for (size_t r = 0; r < sizeof(readers) / sizeof(readers[0]); r++)
+    {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            char path[64];
+            write_region(path, sizes[i]);
+
+            struct region_file rf = { 0 };
+            bool opened = region_file_open(&rf, path, readers[r]);
+            unlink(path);
+            assert_false(opened);
+            assert_null(rf.data);
+        }
+
+        // Only the location table, and a file with a chunk.
+        char path[64];
+        write_region(path, REGION_SECTOR_SIZE);
+        struct region_file rf;
+        assert_true(region_file_open(&rf, path, readers[r]));
+        unlink(path);
+        assert_true(rf.size >= REGION_SECTOR_SIZE);
+        region_file_close(&rf);
+
+        write_region(path, 3 * REGION_SECTOR_SIZE);
+        assert_true(region_file_open(&rf, path, readers[r]));
+        unlink(path);
+        assert_true(rf.size >= 3 * REGION_SECTOR_SIZE);
+        assert_int_equal(rf.data[2 * REGION_SECTOR_SIZE + 1], 1);
+        region_file_close(&rf);
+    }
+}
@@ -0,0 +1,99 @@
+/*
+  anvil2dem - Generate a DEM from .mca files.
+  Copyright (C) 2017-2021  Martijn Heil
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as published
+  by the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "world.h"
+#include "test_world.h"
+
+struct test_filename
+{
+    const char *filename;
+    long long x;
+    long long z;
+};
+
+static const struct test_filename valid_filenames[] = {
+    { "r.0.0.mca", 0, 0 },
+    { "r.-1.2.mca", -1, 2 },
+    { "r.12.-34.mca", 12, -34 },
+    { "r.-0.-0.mca", 0, 0 },
+    { "r.007.10.mca", 7, 10 },
+    { "r.67108863.-67108864.mca", 67108863, -67108864 },   // the furthest regions chunk positions reach
+};
+
+static const char *const invalid_filenames[] = {
+    "",
+    "r.mca",
+    "r.0.mca",
+    "r.0.0",
+    "r.0.0.",
+    "r.0.0.mcr",
+    "r.0.0.mca.bak",
+    "r.0.0.0.mca",
+    "r..0.mca",
+    "r.-.0.mca",
+    "r.x.0.mca",
+    "r.0x1.0.mca",
+    "r.1e3.0.mca",
+    "r. 1.0.mca",
+    "r.+1.0.mca",
+    "r.1 .0.mca",
+    "R.0.0.mca",
+    "c.0.0.mca",
+    "level.dat",
+    ".r.0.0.mca",
+    "r.67108864.0.mca",
+    "r.0.-67108865.mca",
+    "r.99999999999999999999.0.mca",
+    "r.0.-99999999999999999999.mca",
+};
+
+void test_region_filename_coords(void **state)
+{
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(valid_filenames) / sizeof(valid_filenames[0]); i++)
+    {
+        const struct test_filename *test_case = valid_filenames + i;
+        long long x = 1, z = 1;
+        assert_true(region_filename_coords(test_case->filename, &x, &z));
+        assert_int_equal(x, test_case->x);
+        assert_int_equal(z, test_case->z);
+    }
+}
+
+void test_region_filename_coords_invalid(void **state)
+{
+    (void) state;
+
+    for (size_t i = 0; i < sizeof(invalid_filenames) / sizeof(invalid_filenames[0]); i++)
+    {
+        long long x = 1, z = 2;
+        if (region_filename_coords(invalid_filenames[i], &x, &z))
+            fail_msg("'%s' was taken for a region file name", invalid_filenames[i]);
+
+        // Nothing is written for names that aren't region file names.
+        assert_int_equal(x, 1);
+        assert_int_equal(z, 2);
+    }
+}